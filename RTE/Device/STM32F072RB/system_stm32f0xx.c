@@ -139,7 +139,14 @@ __I uint8_t AHBPrescTable[16] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9}
   * @{
   */
 
+/* HSE is not fitted on the Nucleo board and main() runs the PLL from HSI, so
+   SetSysClock() only waited for HSE to time out, which held the first output
+   sample back by tens of milliseconds. Remove this define if HSE is fitted. */
+#define HSE_NOT_FITTED
+
+#ifndef HSE_NOT_FITTED
 static void SetSysClock(void);
+#endif
 
 /**
   * @}
@@ -190,8 +197,10 @@ void SystemInit (void)
   /* Disable all interrupts */
   RCC->CIR = 0x00000000;
 
+#ifndef HSE_NOT_FITTED
   /* Configure the System clock frequency, AHB/APBx prescalers and Flash settings */
   SetSysClock();
+#endif
 }
 
 /**
@@ -281,6 +290,7 @@ void SystemCoreClockUpdate (void)
   * @param  None
   * @retval None
   */
+#ifndef HSE_NOT_FITTED
 static void SetSysClock(void)
 {
   __IO uint32_t StartUpCounter = 0, HSEStatus = 0;
@@ -342,6 +352,7 @@ static void SetSysClock(void)
          configuration. User can add here some code to deal with this error */
   }  
 }
+#endif
 
 /**
   * @}
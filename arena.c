@@ -0,0 +1,366 @@
+
+/** @file arena.c
+ *  @brief Static arena allocator
+ *
+ *	Sample tables are allocated from a single statically allocated region
+ *	instead of the heap. Blocks are referred to by handles which stay valid
+ *	when compaction moves the blocks around, so arena_ptr() has to be called
+ *	again after anything that may compact the arena.
+ *
+ *	Blocks which are read by the DMA must be pinned. Pinned blocks are never
+ *	moved and compaction packs the other blocks around them.
+ */
+
+#include <string.h>
+#include "arena.h"
+
+/** The structure describing a block of the arena */
+struct arena_block {
+	uint16_t offset;	/** Offset from the start of the arena in words */
+	uint16_t size;		/** Size in words */
+	uint16_t align;		/** Alignment in words */
+	bool used;
+	bool pinned;
+};
+
+static uint32_t arena_find_space(uint32_t size, uint32_t align);
+static uint32_t arena_find_space_top(uint32_t size, uint32_t align);
+static int arena_alloc_at(uint32_t size, uint32_t align, bool top);
+static int arena_next_block(bool *done);
+
+/** Memory handed out by the allocator */
+static uint32_t arena_mem[ARENA_SIZE_WORDS];
+
+/** Block table indexed by handle */
+static struct arena_block arena_blocks[ARENA_MAX_BLOCKS];
+
+/** @name Usage counters in words */
+/** @{*/
+
+static uint32_t arena_used;
+static uint32_t arena_peak_used;
+static uint32_t arena_peak_end;
+static uint32_t arena_failed;
+
+/** @}*/
+
+/** @brief Finds the lowest free space for a block.
+ *	@param size Size of the block in words.
+ *	@param align Alignment of the block in words.
+ *	@returns Offset of the space in words, or ARENA_SIZE_WORDS if none.
+ *
+ *	Candidates are the start of the arena and the end of every used block.
+ */
+static uint32_t arena_find_space(uint32_t size, uint32_t align)
+{
+	uint32_t best;
+	uint32_t start;
+	uint32_t end;
+	int i;
+	int j;
+
+	best = ARENA_SIZE_WORDS;
+
+	for (i = -1; i < ARENA_MAX_BLOCKS; i++) {
+		if (i < 0)
+			start = 0;
+		else if (arena_blocks[i].used)
+			start = arena_blocks[i].offset + arena_blocks[i].size;
+		else
+			continue;
+
+		start = (start + align - 1) & ~(align - 1);
+		end = start + size;
+
+		if ((end > ARENA_SIZE_WORDS) || (start >= best))
+			continue;
+
+		for (j = 0; j < ARENA_MAX_BLOCKS; j++) {
+			if (arena_blocks[j].used &&
+				(arena_blocks[j].offset < end) &&
+				(arena_blocks[j].offset + arena_blocks[j].size > start))
+				break;
+		}
+
+		if (j == ARENA_MAX_BLOCKS)
+			best = start;
+	}
+
+	return best;
+}
+
+/** @brief Finds the highest free space for a block.
+ *	@param size Size of the block in words.
+ *	@param align Alignment of the block in words.
+ *	@returns Offset of the space in words, or ARENA_SIZE_WORDS if none.
+ *
+ *	Candidates end at the end of the arena and at the start of every used
+ *	block.
+ */
+static uint32_t arena_find_space_top(uint32_t size, uint32_t align)
+{
+	uint32_t best;
+	uint32_t start;
+	uint32_t end;
+	int i;
+	int j;
+
+	best = ARENA_SIZE_WORDS;
+
+	for (i = -1; i < ARENA_MAX_BLOCKS; i++) {
+		if (i < 0)
+			end = ARENA_SIZE_WORDS;
+		else if (arena_blocks[i].used)
+			end = arena_blocks[i].offset;
+		else
+			continue;
+
+		if (end < size)
+			continue;
+
+		start = (end - size) & ~(align - 1);
+		end = start + size;
+
+		if ((best != ARENA_SIZE_WORDS) && (start <= best))
+			continue;
+
+		for (j = 0; j < ARENA_MAX_BLOCKS; j++) {
+			if (arena_blocks[j].used &&
+				(arena_blocks[j].offset < end) &&
+				(arena_blocks[j].offset + arena_blocks[j].size > start))
+				break;
+		}
+
+		if (j == ARENA_MAX_BLOCKS)
+			best = start;
+	}
+
+	return best;
+}
+
+/** @brief Allocates a block at the lowest or highest free space.
+ *	@param size Size of the block in bytes.
+ *	@param align Alignment of the block in bytes.
+ *	@param top true to take the highest free space.
+ *	@returns Handle of the block, or -1 if there is no space.
+ */
+static int arena_alloc_at(uint32_t size, uint32_t align, bool top)
+{
+	uint32_t offset;
+	int handle;
+
+	size = (size + 3) / 4;
+	align = (align + 3) / 4;
+
+	if ((size == 0) || (align == 0) || (align & (align - 1)))
+		return -1;
+
+	for (handle = 0; handle < ARENA_MAX_BLOCKS; handle++) {
+		if (!arena_blocks[handle].used)
+			break;
+	}
+
+	if (handle == ARENA_MAX_BLOCKS) {
+		arena_failed++;
+		return -1;
+	}
+
+	offset = top ? arena_find_space_top(size, align) :
+				arena_find_space(size, align);
+	if (offset == ARENA_SIZE_WORDS) {
+		arena_compact();
+		offset = top ? arena_find_space_top(size, align) :
+					arena_find_space(size, align);
+	}
+
+	if (offset == ARENA_SIZE_WORDS) {
+		arena_failed++;
+		return -1;
+	}
+
+	arena_blocks[handle].offset = offset;
+	arena_blocks[handle].size = size;
+	arena_blocks[handle].align = align;
+	arena_blocks[handle].used = true;
+	arena_blocks[handle].pinned = false;
+
+	arena_used += size;
+	if (arena_used > arena_peak_used)
+		arena_peak_used = arena_used;
+	if (offset + size > arena_peak_end)
+		arena_peak_end = offset + size;
+
+	return handle;
+}
+
+/** @brief Allocates a block.
+ *	@param size Size of the block in bytes.
+ *	@param align Alignment of the block in bytes, a power of two. Alignments
+ *	below 4 are rounded up to 4.
+ *	@returns Handle of the block, or -1 if there is no space.
+ *
+ *	The block takes the lowest free space. The arena is compacted and
+ *	searched again when there is no space.
+ */
+int arena_alloc(uint32_t size, uint32_t align)
+{
+	return arena_alloc_at(size, align, false);
+}
+
+/** @brief Allocates a block at the top of the arena.
+ *	@param size Size of the block in bytes.
+ *	@param align Alignment of the block in bytes, a power of two. Alignments
+ *	below 4 are rounded up to 4.
+ *	@returns Handle of the block, or -1 if there is no space.
+ *
+ *	As arena_alloc() but the block takes the highest free space. Two blocks
+ *	pinned at opposite ends leave the free space in one piece.
+ */
+int arena_alloc_top(uint32_t size, uint32_t align)
+{
+	return arena_alloc_at(size, align, true);
+}
+
+/** @brief Frees a block.
+ *	@param handle Handle of the block, -1 is ignored.
+ */
+void arena_free(int handle)
+{
+	if ((handle < 0) || (handle >= ARENA_MAX_BLOCKS) ||
+		!arena_blocks[handle].used)
+		return;
+
+	arena_used -= arena_blocks[handle].size;
+	arena_blocks[handle].used = false;
+	arena_blocks[handle].pinned = false;
+}
+
+/** @brief Reads the address of a block.
+ *	@param handle Handle of the block.
+ *	@returns The address, or NULL if the handle is not allocated.
+ */
+uint32_t *arena_ptr(int handle)
+{
+	if ((handle < 0) || (handle >= ARENA_MAX_BLOCKS) ||
+		!arena_blocks[handle].used)
+		return NULL;
+
+	return &arena_mem[arena_blocks[handle].offset];
+}
+
+/** @brief Reads the size of a block.
+ *	@param handle Handle of the block.
+ *	@returns The size in bytes, or 0 if the handle is not allocated.
+ */
+uint32_t arena_block_size(int handle)
+{
+	if ((handle < 0) || (handle >= ARENA_MAX_BLOCKS) ||
+		!arena_blocks[handle].used)
+		return 0;
+
+	return arena_blocks[handle].size * 4;
+}
+
+/** @brief Pins or unpins a block.
+ *	@param handle Handle of the block.
+ *	@param pinned true to stop compaction from moving the block.
+ */
+void arena_pin(int handle, bool pinned)
+{
+	if ((handle < 0) || (handle >= ARENA_MAX_BLOCKS) ||
+		!arena_blocks[handle].used)
+		return;
+
+	arena_blocks[handle].pinned = pinned;
+}
+
+/** @brief Finds the used block with the lowest offset not visited yet.
+ *	@param done Array of ARENA_MAX_BLOCKS flags marking blocks to skip.
+ *	@returns Handle of the block, or -1 if none.
+ */
+static int arena_next_block(bool *done)
+{
+	int next;
+	int i;
+
+	next = -1;
+	for (i = 0; i < ARENA_MAX_BLOCKS; i++) {
+		if (!arena_blocks[i].used || done[i])
+			continue;
+
+		if ((next < 0) || (arena_blocks[i].offset < arena_blocks[next].offset))
+			next = i;
+	}
+
+	return next;
+}
+
+/** @brief Moves unpinned blocks down to close the gaps between blocks.
+ *
+ *	Blocks keep their order. An unpinned block is moved to the end of the
+ *	block before it, pinned blocks stay where they are.
+ */
+void arena_compact(void)
+{
+	bool done[ARENA_MAX_BLOCKS];
+	uint32_t cursor;
+	uint32_t offset;
+	int i;
+
+	memset(done, 0, sizeof(done));
+	cursor = 0;
+
+	while ((i = arena_next_block(done)) >= 0) {
+		done[i] = true;
+
+		if (!arena_blocks[i].pinned) {
+			offset = (cursor + arena_blocks[i].align - 1) &
+						~((uint32_t)arena_blocks[i].align - 1);
+
+			if (offset < arena_blocks[i].offset) {
+				memmove(&arena_mem[offset], &arena_mem[arena_blocks[i].offset],
+						arena_blocks[i].size * 4);
+				arena_blocks[i].offset = offset;
+			}
+		}
+
+		cursor = arena_blocks[i].offset + arena_blocks[i].size;
+	}
+}
+
+/** @brief Reads the usage report of the arena.
+ *	@param stats Container for the report.
+ */
+void arena_read_stats(struct arena_stats *stats)
+{
+	bool done[ARENA_MAX_BLOCKS];
+	uint32_t largest;
+	uint32_t cursor;
+	int i;
+
+	memset(done, 0, sizeof(done));
+	largest = 0;
+	cursor = 0;
+	stats->blocks = 0;
+
+	/* Walk the blocks in address order measuring the gaps between them */
+	while ((i = arena_next_block(done)) >= 0) {
+		done[i] = true;
+		stats->blocks++;
+
+		if (arena_blocks[i].offset - cursor > largest)
+			largest = arena_blocks[i].offset - cursor;
+
+		cursor = arena_blocks[i].offset + arena_blocks[i].size;
+	}
+
+	if (ARENA_SIZE_WORDS - cursor > largest)
+		largest = ARENA_SIZE_WORDS - cursor;
+
+	stats->size = ARENA_SIZE_WORDS * 4;
+	stats->used = arena_used * 4;
+	stats->largest_free = largest * 4;
+	stats->peak_used = arena_peak_used * 4;
+	stats->peak_end = arena_peak_end * 4;
+	stats->failed = arena_failed;
+}
@@ -0,0 +1,41 @@
+
+/** @file arena.h
+ *  @brief Static arena allocator include file
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include "stm32f0xx.h"
+
+/** Size of the arena in 32 bit words */
+#define ARENA_SIZE_WORDS		2000
+
+/** Maximum number of blocks allocated at the same time */
+#define ARENA_MAX_BLOCKS		16
+
+/** Usage report of the arena, sizes are in bytes */
+struct arena_stats {
+	uint32_t size;			/** Total size of the arena */
+	uint32_t used;			/** Bytes allocated */
+	uint32_t largest_free;	/** Largest allocation possible without compaction */
+	uint32_t peak_used;		/** High-water mark of used */
+	uint32_t peak_end;		/** High-water mark of the end of the last block */
+	uint32_t blocks;		/** Number of blocks allocated */
+	uint32_t failed;		/** Number of allocations that failed */
+};
+
+int arena_alloc(uint32_t size, uint32_t align);
+int arena_alloc_top(uint32_t size, uint32_t align);
+void arena_free(int handle);
+
+uint32_t *arena_ptr(int handle);
+uint32_t arena_block_size(int handle);
+
+void arena_pin(int handle, bool pinned);
+void arena_compact(void);
+
+void arena_read_stats(struct arena_stats *stats);
+
+#endif	/* ARENA_H */
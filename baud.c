@@ -0,0 +1,56 @@
+
+/** @file baud.c
+ *  @brief USART baud rate calculation
+ *
+ *	Computes the BRR value of an STM32F0 USART. Unlike the F1 USART, BRR is
+ *	not split into a mantissa and a fraction of a divider by 16:
+ *
+ *	- Oversampling by 16: USARTDIV = fCK / baud and BRR = USARTDIV.
+ *	- Oversampling by 8: USARTDIV = 2 * fCK / baud, BRR[15:4] = USARTDIV[15:4],
+ *	  BRR[2:0] = USARTDIV[3:1] and BRR[3] = 0.
+ *
+ *	USARTDIV must be at least 16 in both modes. As bit 0 of USARTDIV is lost
+ *	with oversampling by 8, both modes divide fCK by a whole number, so
+ *	oversampling by 8 only adds the dividers 8 to 15, between fCK / 16 and
+ *	fCK / 8. Oversampling by 16 tolerates more clock deviation and noise and
+ *	is used whenever it can reach the baud rate.
+ */
+
+#include "baud.h"
+
+/** @brief Computes the USART settings for a baud rate.
+ *	@param pclk Clock of the USART in Hz.
+ *	@param baud The baud rate.
+ *	@param setting Container for the settings.
+ *	@returns 0 if the error is within BAUD_MAX_ERROR_PPM and -1 if otherwise.
+ */
+int baud_compute(uint32_t pclk, uint32_t baud, struct baud_setting *setting)
+{
+	uint32_t div;
+
+	if (baud == 0)
+		return -1;
+
+	/* Whole divider of fCK closest to the baud rate */
+	div = (pclk + baud / 2) / baud;
+	if ((div < BAUD_MIN_USARTDIV / 2) || (div > 0xFFFF))
+		return -1;
+
+	if (div >= BAUD_MIN_USARTDIV) {
+		setting->over8 = false;
+		setting->brr = div;
+	} else {
+		setting->over8 = true;
+		setting->brr = ((2 * div) & 0xFFF0) | (((2 * div) & 0x000F) >> 1);
+	}
+
+	setting->actual = (pclk + div / 2) / div;
+	setting->error_ppm = (int32_t)(((int64_t)setting->actual - baud) *
+		1000000 / baud);
+
+	if ((setting->error_ppm > BAUD_MAX_ERROR_PPM) ||
+		(setting->error_ppm < -BAUD_MAX_ERROR_PPM))
+		return -1;
+
+	return 0;
+}
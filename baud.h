@@ -0,0 +1,28 @@
+
+/** @file baud.h
+ *  @brief USART baud rate calculation include file
+ */
+
+#ifndef BAUD_H
+#define BAUD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Largest baud rate error accepted, in ppm */
+#define BAUD_MAX_ERROR_PPM		10000
+
+/** Smallest USARTDIV allowed by the USART */
+#define BAUD_MIN_USARTDIV		16
+
+/** USART register values for a baud rate */
+struct baud_setting {
+	uint16_t brr;			/** Value of the BRR register */
+	bool over8;				/** Value of the OVER8 bit of CR1 */
+	uint32_t actual;		/** Baud rate produced */
+	int32_t error_ppm;		/** Error of actual against the request */
+};
+
+int baud_compute(uint32_t pclk, uint32_t baud, struct baud_setting *setting);
+
+#endif	/* BAUD_H */
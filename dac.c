@@ -5,8 +5,17 @@
  *  @date April 2016
  */
 
+#include <stdio.h>
 #include "dac.h"
 
+/** @name Underrun callback function handlers */
+/** @{*/
+
+static void (*dac1_underrun_callback)(void) = NULL;
+static void (*dac2_underrun_callback)(void) = NULL;
+
+/** @}*/
+
 /**	@brief Initializes a DAC channel.
  *	@param chn Channel to initialize.
  *	@returns Returns 0 if successful and -1 if otherwise.
@@ -69,11 +78,7 @@ int dac_disable(enum dac_channel chn)
 	if ((chn != DAC_CHN_1) && (chn != DAC_CHN_2))
 		return -1;
 	
-	if (chn == DAC_CHN_1)
-		DAC->CR &= ~(DAC_CR_EN1);
-	else
-		DAC->CR &= ~(DAC_CR_EN2);
-	
+	dac_disable_fixed(chn);
 	return 0;
 }
 
@@ -82,14 +87,93 @@ int dac_disable(enum dac_channel chn)
  *	@returns Returns 0 if successful and -1 if otherwise.
  */
 int dac_enable(enum dac_channel chn)
+{
+	if ((chn != DAC_CHN_1) && (chn != DAC_CHN_2))
+		return -1;
+	
+	dac_enable_fixed(chn);
+	return 0;
+}
+
+/** @brief Enables the DMA underrun interrupt of a channel.
+ *	@param chn The channel to configure.
+ *	@param callback Function called from the interrupt to restart the DMA
+ *	channel feeding the DAC.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	An underrun happens when a trigger arrives before the DMA wrote the data
+ *	of the previous one, for example when the bus is busy. The DAC then stops
+ *	requesting DMA and keeps converting its last sample. The interrupt shares
+ *	the vector of Timer 6, see dac_handle_interrupt().
+ */
+int dac_enable_underrun_interrupt(enum dac_channel chn, void (*callback)(void))
+{
+	if ((chn != DAC_CHN_1) && (chn != DAC_CHN_2))
+		return -1;
+	
+	if (callback == NULL)
+		return -1;
+	
+	if (chn == DAC_CHN_1) {
+		dac1_underrun_callback = callback;
+		DAC->SR = DAC_SR_DMAUDR1;		/* Clear stale flag */
+		DAC->CR |= DAC_CR_DMAUDRIE1;
+	} else {
+		dac2_underrun_callback = callback;
+		DAC->SR = DAC_SR_DMAUDR2;
+		DAC->CR |= DAC_CR_DMAUDRIE2;
+	}
+	
+	NVIC_EnableIRQ(TIM6_DAC_IRQn);
+	
+	return 0;
+}
+
+/** @brief Disables the DMA underrun interrupt of a channel.
+ *	@param chn The channel to configure.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	@note The shared interrupt vector is left enabled for Timer 6.
+ */
+int dac_disable_underrun_interrupt(enum dac_channel chn)
 {
 	if ((chn != DAC_CHN_1) && (chn != DAC_CHN_2))
 		return -1;
 	
 	if (chn == DAC_CHN_1)
-		DAC->CR |= DAC_CR_EN1;
+		DAC->CR &= ~(DAC_CR_DMAUDRIE1);
 	else
-		DAC->CR |= DAC_CR_EN2;
+		DAC->CR &= ~(DAC_CR_DMAUDRIE2);
 	
 	return 0;
 }
+
+/** @brief Services the DMA underrun interrupt of both channels.
+ *
+ *	Called from TIM6_DAC_IRQHandler() as the DAC shares its vector. For each
+ *	channel in underrun, DMA is disabled and the flag cleared as the Reference
+ *	Manual requires, then the callback restarts the DMA channel and DMA is
+ *	enabled again so the next trigger fetches data.
+ */
+void dac_handle_interrupt(void)
+{
+	if ((DAC->CR & DAC_CR_DMAUDRIE1) && (DAC->SR & DAC_SR_DMAUDR1)) {
+		DAC->CR &= ~(DAC_CR_DMAEN1);
+		DAC->SR = DAC_SR_DMAUDR1;		/* Cleared by writing 1 */
+		
+		if (dac1_underrun_callback)
+			dac1_underrun_callback();
+		
+		DAC->CR |= DAC_CR_DMAEN1;
+	}
+	
+	if ((DAC->CR & DAC_CR_DMAUDRIE2) && (DAC->SR & DAC_SR_DMAUDR2)) {
+		DAC->CR &= ~(DAC_CR_DMAEN2);
+		DAC->SR = DAC_SR_DMAUDR2;
+		
+		if (dac2_underrun_callback)
+			dac2_underrun_callback();
+		
+		DAC->CR |= DAC_CR_DMAEN2;
+	}
+}
@@ -20,4 +20,26 @@ int dac_init(enum dac_channel chn);
 int dac_disable(enum dac_channel chn);
 int dac_enable(enum dac_channel chn);
 
+int dac_disable_underrun_interrupt(enum dac_channel chn);
+int dac_enable_underrun_interrupt(enum dac_channel chn, void (*callback)(void));
+void dac_handle_interrupt(void);
+
+/** @name Fixed channel variants
+ *	For a channel fixed at compile time. The channel is not checked and the
+ *	bit folds to a constant, so each compiles to the register access alone.
+ */
+/** @{*/
+
+static inline void dac_disable_fixed(enum dac_channel chn)
+{
+	DAC->CR &= ~((chn == DAC_CHN_1) ? DAC_CR_EN1 : DAC_CR_EN2);
+}
+
+static inline void dac_enable_fixed(enum dac_channel chn)
+{
+	DAC->CR |= (chn == DAC_CHN_1) ? DAC_CR_EN1 : DAC_CR_EN2;
+}
+
+/** @}*/
+
 #endif	/* DAC_H */
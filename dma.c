@@ -5,11 +5,20 @@
  *  @date May 2016
  */
 
+#include <stdio.h>
 #include "dma.h"
 
 static void dma_extract_base_pointer(enum dma_channel chn,
 								DMA_Channel_TypeDef **dma);
 
+/** @name Callback function handlers */
+/** @{*/
+
+void (*dma3_callback)(void) = NULL;
+void (*dma4_callback)(void) = NULL;
+
+/** @}*/
+
 /** @brief Extracts the DMA channel base pointer.
  *	@param The channel of interest.
  *	@param dma Handle to DMA base pointer.
@@ -27,38 +36,29 @@ static void dma_extract_base_pointer(enum dma_channel chn,
 /** @brief Initializes the DMA for DAC use.
  *	@param chn The DMA channel to initialize.
  *	@param read_mem Handle to DMA read memory location.
- *	@param num_read Size of read_mem.
+ *	@param num_read Number of samples in read_mem.
+ *	@param size Data path to use. DMA_DATA_12BIT reads one sample per 32 bit
+ *	word into DHR12Rx while DMA_DATA_8BIT reads one sample per byte into
+ *	DHR8Rx, packing four samples into each word of read_mem.
  *	@returns 0 if successful and -1 if otherwise.
  */
-int dma_init(enum dma_channel chn, uint32_t *read_mem, uint32_t num_read)
+int dma_init(enum dma_channel chn, const uint32_t *read_mem, uint32_t num_read,
+			enum dma_data_size size)
 {
-	DMA_Channel_TypeDef *dma;
-	
 	if ((chn != DMA_CHN_3) && (chn != DMA_CHN_4))
 		return -1;
-	
-	dma_extract_base_pointer(chn, &dma);
 
 	/* Enable clock for DMA */
 	RCC->AHBENR |= RCC_AHBENR_DMA1EN;
 	
-	/* Assign DMA transfer read and write memory locations */
-	dma->CMAR = (uint32_t)(read_mem);
-	
-	if (chn == DMA_CHN_3)
-		dma->CPAR = (uint32_t)(&DAC->DHR12R1);
-	else
-		dma->CPAR = (uint32_t)(&DAC->DHR12R2);
-	
-	dma->CNDTR = num_read;
-	
-	/* 1. Enable increment mode,
-	   2. Set read memory size to 32 bits,
+	/* Assign the read and write memory locations and the count, clear sizes
+	   left over from a previous data path, then
+	   1. Enable increment mode,
+	   2. Set read memory size to 32 bits (8 bits for the 8 bit path),
 	   3. Set write memory size to 32 bits,
 	   4. Enable circular mode
 	   5. Set to read from memory mode */
-	dma->CCR |=DMA_CCR_MINC | DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1
-				| DMA_CCR_CIRC | DMA_CCR_DIR;
+	dma_load_fixed(chn, read_mem, num_read, size);
 	
 	return 0;
 }
@@ -68,23 +68,78 @@ int dma_init(enum dma_channel chn, uint32_t *read_mem, uint32_t num_read)
  *	@returns 0 if successful and -1 if otherwise.
  */
 int dma_disable(enum dma_channel chn)
+{
+	if ((chn != DMA_CHN_3) && (chn != DMA_CHN_4))
+		return -1;
+	
+	dma_disable_fixed(chn);
+	return 0;
+}
+
+/**	@brief Enables a DMA channel.
+ *	@param chn The DMA channel to enable.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int dma_enable(enum dma_channel chn)
+{
+	if ((chn != DMA_CHN_3) && (chn != DMA_CHN_4))
+		return -1;
+	
+	dma_enable_fixed(chn);
+	return 0;
+}
+
+/** @brief Reads the number of transfers left before the channel wraps.
+ *	@param chn The DMA channel to read.
+ *	@param count Container for the CNDTR value.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int dma_read_count(enum dma_channel chn, uint32_t *count)
+{
+	if ((chn != DMA_CHN_3) && (chn != DMA_CHN_4))
+		return -1;
+	
+	*count = dma_read_count_fixed(chn);
+	return 0;
+}
+
+/** @brief Enables the transfer complete interrupt of a DMA channel.
+ *	@param chn The DMA channel to configure.
+ *	@param callback Function called from the interrupt at the end of every
+ *	pass through read_mem.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int dma_enable_interrupt(enum dma_channel chn, void (*callback)(void))
 {
 	DMA_Channel_TypeDef *dma;
 	
 	if ((chn != DMA_CHN_3) && (chn != DMA_CHN_4))
 		return -1;
 	
+	if (callback == NULL)
+		return -1;
+	
 	dma_extract_base_pointer(chn, &dma);
 	
-	dma->CCR &= ~(DMA_CCR_EN);
+	if (chn == DMA_CHN_3) {
+		dma3_callback = callback;
+		DMA1->IFCR = DMA_IFCR_CGIF3;
+		NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+	} else {
+		dma4_callback = callback;
+		DMA1->IFCR = DMA_IFCR_CGIF4;
+		NVIC_EnableIRQ(DMA1_Channel4_5_6_7_IRQn);
+	}
+	
+	dma->CCR |= DMA_CCR_TCIE;
 	return 0;
 }
 
-/**	@brief Enables a DMA channel.
- *	@param chn The DMA channel to enable.
+/** @brief Disables the transfer complete interrupt of a DMA channel.
+ *	@param chn The DMA channel to configure.
  *	@returns 0 if successful and -1 if otherwise.
  */
-int dma_enable(enum dma_channel chn)
+int dma_disable_interrupt(enum dma_channel chn)
 {
 	DMA_Channel_TypeDef *dma;
 	
@@ -93,6 +148,35 @@ int dma_enable(enum dma_channel chn)
 	
 	dma_extract_base_pointer(chn, &dma);
 	
-	dma->CCR |= DMA_CCR_EN;
+	dma->CCR &= ~(DMA_CCR_TCIE);
 	return 0;
 }
+
+/** @name DMA Interrupt Service Routine. */
+/** @{*/
+
+/** @brief IRQ Handler for DMA channel 2 and 3
+ */
+void DMA1_Channel2_3_IRQHandler(void)
+{
+	if (DMA1->ISR & DMA_ISR_TCIF3) {
+		DMA1->IFCR = DMA_IFCR_CGIF3;
+		
+		if (dma3_callback)
+			dma3_callback();
+	}
+}
+
+/** @brief IRQ Handler for DMA channel 4, 5, 6 and 7
+ */
+void DMA1_Channel4_5_6_7_IRQHandler(void)
+{
+	if (DMA1->ISR & DMA_ISR_TCIF4) {
+		DMA1->IFCR = DMA_IFCR_CGIF4;
+		
+		if (dma4_callback)
+			dma4_callback();
+	}
+}
+
+/** @}*/
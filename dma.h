@@ -16,9 +16,85 @@ enum dma_channel {
 	DMA_CHN_4 = 1	/** Used with DAC channel 2 */
 };
 
-int dma_init(enum dma_channel chn, uint32_t *read_mem, uint32_t num_read);
+/** Enumeration for the DAC data path fed by the DMA */
+enum dma_data_size {
+	DMA_DATA_12BIT = 0,	/** 32 bit words into DHR12Rx */
+	DMA_DATA_8BIT = 1	/** Bytes into DHR8Rx */
+};
+
+int dma_init(enum dma_channel chn, const uint32_t *read_mem, uint32_t num_read,
+			enum dma_data_size size);
 
 int dma_disable(enum dma_channel chn);
 int dma_enable(enum dma_channel chn);
 
+int dma_read_count(enum dma_channel chn, uint32_t *count);
+
+int dma_disable_interrupt(enum dma_channel chn);
+int dma_enable_interrupt(enum dma_channel chn, void (*callback)(void));
+
+/** @name Fixed channel variants
+ *	For a channel fixed at compile time. The channel is not checked and its
+ *	base pointer folds to a constant, so each compiles to the register access
+ *	alone. dma_init() must have been called once for the channel.
+ */
+/** @{*/
+
+static inline DMA_Channel_TypeDef *dma_base_fixed(enum dma_channel chn)
+{
+	return (chn == DMA_CHN_3) ? DMA1_Channel3 : DMA1_Channel4;
+}
+
+static inline void dma_load_fixed(enum dma_channel chn,
+			const uint32_t *read_mem, uint32_t num_read, enum dma_data_size size)
+{
+	DMA_Channel_TypeDef *dma = dma_base_fixed(chn);
+	
+	dma->CMAR = (uint32_t)(uintptr_t)(read_mem);
+	
+	if (size == DMA_DATA_8BIT)
+		dma->CPAR = (chn == DMA_CHN_3) ? (uint32_t)(uintptr_t)(&DAC->DHR8R1) :
+					(uint32_t)(uintptr_t)(&DAC->DHR8R2);
+	else
+		dma->CPAR = (chn == DMA_CHN_3) ? (uint32_t)(uintptr_t)(&DAC->DHR12R1) :
+					(uint32_t)(uintptr_t)(&DAC->DHR12R2);
+	
+	dma->CNDTR = num_read;
+	
+	if (size == DMA_DATA_8BIT)
+		dma->CCR = (dma->CCR & ~(DMA_CCR_MSIZE | DMA_CCR_PSIZE)) |
+					DMA_CCR_MINC | DMA_CCR_PSIZE_1 | DMA_CCR_CIRC | DMA_CCR_DIR;
+	else
+		dma->CCR = (dma->CCR & ~(DMA_CCR_MSIZE | DMA_CCR_PSIZE)) |
+					DMA_CCR_MINC | DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1 |
+					DMA_CCR_CIRC | DMA_CCR_DIR;
+}
+
+static inline void dma_reload_fixed(enum dma_channel chn,
+			const uint32_t *read_mem, uint32_t num_read)
+{
+	DMA_Channel_TypeDef *dma = dma_base_fixed(chn);
+	
+	/* The data path is left as loaded last */
+	dma->CMAR = (uint32_t)(uintptr_t)(read_mem);
+	dma->CNDTR = num_read;
+}
+
+static inline void dma_disable_fixed(enum dma_channel chn)
+{
+	dma_base_fixed(chn)->CCR &= ~(DMA_CCR_EN);
+}
+
+static inline void dma_enable_fixed(enum dma_channel chn)
+{
+	dma_base_fixed(chn)->CCR |= DMA_CCR_EN;
+}
+
+static inline uint32_t dma_read_count_fixed(enum dma_channel chn)
+{
+	return dma_base_fixed(chn)->CNDTR;
+}
+
+/** @}*/
+
 #endif	/* DMA_H */
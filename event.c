@@ -0,0 +1,151 @@
+
+/** @file event.c
+ *  @brief Event flag scheduler
+ *
+ *	Interrupt handlers post event flags with event_post() and the main loop
+ *	collects them with event_take(). When there is nothing left to service the
+ *	main loop calls event_wait() which sleeps the core with WFI until the next
+ *	interrupt. Time spent asleep and the number of wake ups are recorded so
+ *	the idle percentage can be reported. Other waits, such as for room in the
+ *	serial ring buffers or for a key at a menu prompt, sleep with
+ *	event_sleep() so they are recorded too.
+ */
+
+#include "event.h"
+#include "systick.h"
+
+/** Pending event flags */
+static volatile uint32_t event_pending;
+
+/** @name Sleep statistics
+ *	Accumulated since the last call to event_read_stats().
+ */
+/** @{*/
+
+static uint32_t stats_start_ms;
+static uint64_t stats_idle_cycles;
+static uint32_t stats_wakes;
+static uint32_t stats_event_wakes;
+
+/** @}*/
+
+/** @brief Clears pending events and sleep statistics.
+ *
+ *	@note systick_init() must be called before this.
+ */
+void event_init(void)
+{
+	event_pending = 0;
+	
+	stats_start_ms = systick_get_ms();
+	stats_idle_cycles = 0;
+	stats_wakes = 0;
+	stats_event_wakes = 0;
+}
+
+/** @brief Posts events to the main loop.
+ *	@param events Bitwise OR of enum event_flag.
+ *
+ *	This is safe to call from interrupt handlers.
+ */
+void event_post(uint32_t events)
+{
+	uint32_t primask;
+	
+	primask = __get_PRIMASK();
+	__disable_irq();
+	event_pending |= events;
+	__set_PRIMASK(primask);
+}
+
+/** @brief Takes all pending events.
+ *	@returns Bitwise OR of the events posted since the last call.
+ */
+uint32_t event_take(void)
+{
+	uint32_t events;
+	
+	__disable_irq();
+	events = event_pending;
+	event_pending = 0;
+	__enable_irq();
+	
+	return events;
+}
+
+/** @brief Sleeps until an interrupt occurs if no event is pending.
+ *
+ *	Interrupts are masked while checking for pending events so an event posted
+ *	just before WFI cannot be missed. WFI still wakes up on a masked interrupt
+ *	which is then serviced once the mask is lifted.
+ */
+void event_wait(void)
+{
+	uint32_t start;
+	
+	__disable_irq();
+	
+	if (event_pending != 0) {
+		__enable_irq();
+		return;
+	}
+	
+	start = systick_get_cycles();
+	__WFI();
+	stats_idle_cycles += systick_get_cycles() - start;
+	
+	/* The interrupt which woke the core is serviced here */
+	__enable_irq();
+	
+	stats_wakes++;
+	if (event_pending != 0)
+		stats_event_wakes++;
+}
+
+/** @brief Sleeps until the next interrupt whatever events are pending.
+ *
+ *	For waits on something other than an event flag, which event_wait()
+ *	would not sleep through while unrelated events are pending. The time
+ *	asleep counts as idle.
+ */
+void event_sleep(void)
+{
+	uint32_t start;
+	
+	__disable_irq();
+	
+	start = systick_get_cycles();
+	__WFI();
+	stats_idle_cycles += systick_get_cycles() - start;
+	
+	/* The interrupt which woke the core is serviced here */
+	__enable_irq();
+	
+	stats_wakes++;
+}
+
+/** @brief Reads and restarts the sleep statistics.
+ *	@param stats Container for the statistics.
+ */
+void event_read_stats(struct event_stats *stats)
+{
+	uint32_t now_ms;
+	uint64_t window_cycles;
+	
+	now_ms = systick_get_ms();
+	
+	stats->window_ms = now_ms - stats_start_ms;
+	stats->wakes = stats_wakes;
+	stats->event_wakes = stats_event_wakes;
+	
+	window_cycles = (uint64_t)stats->window_ms * systick_cycles_per_us() * 1000;
+	if (window_cycles)
+		stats->idle_percent = (uint32_t)((stats_idle_cycles * 100) / window_cycles);
+	else
+		stats->idle_percent = 0;
+	
+	stats_start_ms = now_ms;
+	stats_idle_cycles = 0;
+	stats_wakes = 0;
+	stats_event_wakes = 0;
+}
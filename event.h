@@ -0,0 +1,37 @@
+
+/** @file event.h
+ *  @brief Event flag scheduler include file
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include "stm32f0xx.h"
+
+/** Event flags posted by interrupt handlers to the main loop */
+enum event_flag {
+	EVENT_SERIAL_RX	= (1ul << 0),	/** Character received on USART2 */
+	EVENT_DMA		= (1ul << 1),	/** DMA transfer interrupt */
+	EVENT_TIMER		= (1ul << 2),	/** Timer update interrupt */
+	EVENT_SEQUENCE_END	= (1ul << 3),	/** Sequence played its last step */
+	EVENT_SETTINGS	= (1ul << 4)	/** Settings snapshot posted */
+};
+
+/** Sleep statistics of the main loop */
+struct event_stats {
+	uint32_t window_ms;		/** Time covered by the statistics */
+	uint32_t idle_percent;	/** Percentage of window spent in WFI */
+	uint32_t wakes;			/** Number of WFI wake ups */
+	uint32_t event_wakes;	/** Wake ups which had an event to service */
+};
+
+void event_init(void);
+
+void event_post(uint32_t events);
+uint32_t event_take(void);
+void event_wait(void);
+void event_sleep(void);
+
+void event_read_stats(struct event_stats *stats);
+
+#endif	/* EVENT_H */
@@ -0,0 +1,107 @@
+
+/** @file flash.c
+ *  @brief Flash memory driver
+ *
+ *	Erases and programs the internal flash. The flash is unlocked for each
+ *	operation and locked again afterwards, so a stray write cannot change it.
+ *
+ *	The CPU stalls while it fetches from flash during an erase or program, so
+ *	interrupts are served late and a DMA channel reading flash waits too. A
+ *	page erase takes up to 40 ms.
+ */
+
+#include "flash.h"
+
+/** @brief Unlocks the flash control register.
+ */
+static void flash_unlock(void)
+{
+	if (FLASH->CR & FLASH_CR_LOCK) {
+		FLASH->KEYR = FLASH_KEY1;
+		FLASH->KEYR = FLASH_KEY2;
+	}
+}
+
+/** @brief Locks the flash control register.
+ */
+static void flash_lock(void)
+{
+	FLASH->CR |= FLASH_CR_LOCK;
+}
+
+/** @brief Waits for the operation in progress and checks its result.
+ *	@returns 0 if successful and -1 if the operation failed.
+ */
+static int flash_wait(void)
+{
+	uint32_t sr;
+
+	while (FLASH->SR & FLASH_SR_BSY)
+		;
+
+	sr = FLASH->SR;
+	FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPERR;	/* Cleared by writing 1 */
+
+	if (sr & (FLASH_SR_PGERR | FLASH_SR_WRPERR))
+		return -1;
+
+	return 0;
+}
+
+/** @brief Erases a page of flash.
+ *	@param address Start address of the page.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int flash_erase_page(uint32_t address)
+{
+	int ret;
+
+	if (address % FLASH_PAGE_SIZE)
+		return -1;
+
+	flash_unlock();
+
+	FLASH->CR |= FLASH_CR_PER;
+	FLASH->AR = address;
+	FLASH->CR |= FLASH_CR_STRT;
+	ret = flash_wait();
+	FLASH->CR &= ~(FLASH_CR_PER);
+
+	flash_lock();
+
+	return ret;
+}
+
+/** @brief Programs data into erased flash.
+ *	@param address Address to program, must be halfword aligned.
+ *	@param data The data.
+ *	@param len Number of bytes, must be even.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Flash is programmed one halfword at a time. A halfword which is not
+ *	erased can only be programmed with 0x0000, anything else fails.
+ */
+int flash_program(uint32_t address, const void *data, uint32_t len)
+{
+	const uint8_t *src = data;
+	uint32_t i;
+	int ret = 0;
+
+	if ((address & 1) || (len & 1))
+		return -1;
+
+	flash_unlock();
+
+	FLASH->CR |= FLASH_CR_PG;
+	for (i = 0; i < len; i += 2) {
+		*(__IO uint16_t *)(address + i) = src[i] | (src[i + 1] << 8);
+		ret = flash_wait();
+		if (ret)
+			break;
+	}
+	FLASH->CR &= ~(FLASH_CR_PG);
+
+	flash_lock();
+
+	return ret;
+}
@@ -0,0 +1,20 @@
+
+/** @file flash.h
+ *  @brief Flash memory driver include file
+ */
+
+#ifndef FLASH_H
+#define FLASH_H
+
+#include "stm32f0xx.h"
+
+/** Size of a flash page, the unit of erase */
+#define FLASH_PAGE_SIZE			2048
+
+/** Value of erased flash */
+#define FLASH_ERASED_WORD		0xFFFFFFFFul
+
+int flash_erase_page(uint32_t address);
+int flash_program(uint32_t address, const void *data, uint32_t len);
+
+#endif	/* FLASH_H */
@@ -0,0 +1,182 @@
+
+/** @file freqmeter.c
+ *  @brief Output frequency meter
+ *
+ *	Measures the rate the DAC output is actually produced at. TIM2 is run as
+ *	a free 32 bit counter of core clocks and is read at every transfer
+ *	complete interrupt of the DAC DMA channel, which comes once per pass
+ *	through the table. The passes are counted from the first interrupt to
+ *	the first one at least a gate time later, FREQMETER_GATE_MS unless set
+ *	with freqmeter_set_gate_ms(). The gate always spans
+ *	whole passes and the result has the resolution of the core clock however
+ *	low the output frequency is.
+ *
+ *	TIM6 updates are not counted directly. TIM6 is not a trigger input of
+ *	TIM2 on the F072 and an interrupt per sample would take far more of the
+ *	CPU than one per pass.
+ *
+ *	The reference is the core clock which also runs TIM6, so the result
+ *	checks the timer values, the table and the DMA against the request, and
+ *	shows any pass lost to an underrun, but not the accuracy of the clock.
+ */
+
+#include <stdbool.h>
+#include "freqmeter.h"
+#include "wave_gen.h"
+
+/** @name Gate state, written from the DMA interrupt */
+/** @{*/
+
+static volatile bool freqmeter_open;
+static volatile uint32_t freqmeter_gate_start;
+static volatile uint32_t freqmeter_passes;
+
+/** @}*/
+
+/** Shortest gate in core clocks and in ms */
+static volatile uint32_t freqmeter_gate_clocks;
+static uint32_t freqmeter_gate_ms = FREQMETER_GATE_MS;
+
+/** Samples and waveform cycles in one pass through the table */
+static volatile uint32_t freqmeter_samples;
+static volatile uint32_t freqmeter_cycles;
+
+/** Result of the last gate, valid if passes is not 0 */
+static volatile uint32_t freqmeter_last_passes;
+static volatile uint32_t freqmeter_last_clocks;
+
+/** @brief Counts a pass through the table.
+ *	@note called from the DMA interrupt at the end of every pass
+ */
+static void freqmeter_count(void)
+{
+	uint32_t now = TIM2->CNT;
+	uint32_t clocks;
+	
+	if (!freqmeter_open) {
+		freqmeter_open = true;
+		freqmeter_gate_start = now;
+		freqmeter_passes = 0;
+		return;
+	}
+	
+	freqmeter_passes++;
+	clocks = now - freqmeter_gate_start;
+	if (clocks < freqmeter_gate_clocks)
+		return;
+	
+	freqmeter_last_passes = freqmeter_passes;
+	freqmeter_last_clocks = clocks;
+	
+	/* The end of this gate opens the next one */
+	freqmeter_gate_start = now;
+	freqmeter_passes = 0;
+}
+
+/** @brief Starts measuring a table which has just been set up.
+ *	@param samples Samples in the table.
+ *	@param cycles Waveform cycles in the table.
+ *
+ *	The previous result is dropped and the first gate opens at the end of
+ *	the next pass.
+ */
+void freqmeter_start(uint32_t samples, uint32_t cycles)
+{
+	if (!(TIM2->CR1 & TIM_CR1_CEN)) {
+		RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+		TIM2->PSC = 0;
+		TIM2->ARR = 0xFFFFFFFF;
+		TIM2->EGR = TIM_EGR_UG;
+		TIM2->CR1 |= TIM_CR1_CEN;
+	}
+	
+	dma_disable_interrupt(DMA_CHN);
+	
+	freqmeter_open = false;
+	freqmeter_gate_clocks = (SystemCoreClock / 1000) * freqmeter_gate_ms;
+	freqmeter_samples = samples;
+	freqmeter_cycles = cycles;
+	freqmeter_last_passes = 0;
+	
+	dma_enable_interrupt(DMA_CHN, &freqmeter_count);
+}
+
+/** @brief Stops measuring.
+ *
+ *	The counter is left running for the next start.
+ */
+void freqmeter_stop(void)
+{
+	dma_disable_interrupt(DMA_CHN);
+	freqmeter_open = false;
+	freqmeter_last_passes = 0;
+}
+
+/** @brief Sets the gate time.
+ *	@param gate_ms Shortest gate in ms, FREQMETER_MIN_GATE_MS to
+ *	FREQMETER_MAX_GATE_MS.
+ *	@returns 0 if successful and -1 if the gate is out of range.
+ *
+ *	The gate in progress is restarted and the previous result is dropped.
+ */
+int freqmeter_set_gate_ms(uint32_t gate_ms)
+{
+	uint32_t primask;
+	
+	if ((gate_ms < FREQMETER_MIN_GATE_MS) || (gate_ms > FREQMETER_MAX_GATE_MS))
+		return -1;
+	
+	primask = __get_PRIMASK();
+	__disable_irq();
+	
+	freqmeter_gate_ms = gate_ms;
+	freqmeter_gate_clocks = (SystemCoreClock / 1000) * gate_ms;
+	freqmeter_open = false;
+	freqmeter_last_passes = 0;
+	
+	__set_PRIMASK(primask);
+	
+	return 0;
+}
+
+/** @brief Reads the gate time.
+ *	@returns Shortest gate in ms.
+ */
+uint32_t freqmeter_get_gate_ms(void)
+{
+	return freqmeter_gate_ms;
+}
+
+/** @brief Reads the result of the last gate.
+ *	@param frequency The requested output frequency in Hz.
+ *	@param result Container for the result.
+ *	@returns 0 if successful and -1 if no gate has closed since the start.
+ */
+int freqmeter_read(uint32_t frequency, struct freqmeter_result *result)
+{
+	uint32_t primask;
+	uint64_t scaled;
+	
+	primask = __get_PRIMASK();
+	__disable_irq();
+	
+	result->passes = freqmeter_last_passes;
+	result->clocks = freqmeter_last_clocks;
+	scaled = (uint64_t)freqmeter_last_passes * SystemCoreClock;
+	result->sample_rate = (scaled * freqmeter_samples +
+		result->clocks / 2) / (result->clocks ? result->clocks : 1);
+	scaled *= freqmeter_cycles;
+	
+	__set_PRIMASK(primask);
+	
+	if (result->passes == 0)
+		return -1;
+	
+	result->frequency_mhz = (scaled * 1000 + result->clocks / 2) / result->clocks;
+	result->error_ppm = 0;
+	if (frequency)
+		result->error_ppm = (int32_t)(((int64_t)(scaled * 1000000 /
+			result->clocks) - (int64_t)frequency * 1000000) / frequency);
+	
+	return 0;
+}
@@ -0,0 +1,34 @@
+
+/** @file freqmeter.h
+ *  @brief Output frequency meter include file
+ */
+
+#ifndef FREQMETER_H
+#define FREQMETER_H
+
+#include "stm32f0xx.h"
+
+/** Shortest time passes of the table are counted over, by default and its
+ *	limits. The longest gate must fit the 32 bit counter at 48 MHz. */
+#define FREQMETER_GATE_MS		1000
+#define FREQMETER_MIN_GATE_MS	10
+#define FREQMETER_MAX_GATE_MS	60000
+
+/** Result of the last gate */
+struct freqmeter_result {
+	uint32_t passes;			/** Passes through the table counted */
+	uint32_t clocks;			/** Core clocks taken by the passes */
+	uint32_t sample_rate;		/** Measured sample rate in Hz */
+	uint32_t frequency_mhz;		/** Measured output frequency in mHz */
+	int32_t error_ppm;			/** Deviation from the requested frequency */
+};
+
+void freqmeter_start(uint32_t samples, uint32_t cycles);
+void freqmeter_stop(void);
+
+int freqmeter_set_gate_ms(uint32_t gate_ms);
+uint32_t freqmeter_get_gate_ms(void);
+
+int freqmeter_read(uint32_t frequency, struct freqmeter_result *result);
+
+#endif	/* FREQMETER_H */
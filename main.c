@@ -5,6 +5,7 @@
  *  @date April 2016
  */
 
+#include <string.h>
 #include "stm32f0xx.h"
 #include "timer.h"
 
@@ -15,23 +16,73 @@
 #include "wave_gen.h"
 
 #include "serial.h"
+#include "systick.h"
+#include "event.h"
+#include "sequencer.h"
+#include "trace.h"
+#include "settings.h"
+#include "screen.h"
+#include "preset.h"
+#include "freqmeter.h"
 
-/*system setting structure*/
-struct system_settings {
-	enum waveform wave;
-	unsigned int frequency;
-	float amplitude;
-
-	bool changed;
+/*system setting default, edited by the menus and posted to the output engine*/
+struct waveform_settings settings = {
+	DEFAULT_WAVEFORM,			/* wave */
+	DEFAULT_FREQUENCY,			/* frequency */
+	DEFAULT_AMPLITUDE_FLOAT,	/* amplitude */
+	DEFAULT_OFFSET_FLOAT,		/* offset */
+	{{1, 100, 0}},	/* harmonics */
+	1,		/* harmonic_count */
+	DEFAULT_PULSE_DUTY	/* duty */
 };
 
-/*system setting default*/
-struct system_settings settings = {
-	SINE,	/* wave */
-	1000,	/* frequency */
-	3.3,	/* amplitude */
-	true	/* changed */
-};
+/*time from the end of the clock setup to the output start and to the menu drawn*/
+uint32_t boot_output_us;
+uint32_t boot_menu_us;
+
+/** @brief Send a snapshot of the edited settings to the output engine
+ */
+void post_settings(void)
+{
+	settings_post(&settings);
+}
+
+/** @brief Tell the output engine whether the table it builds is superseded
+ *	@returns 1 if newer settings were posted while building, 0 if otherwise
+ */
+uint8_t generate_superseded(void)
+{
+	return settings_pending() ? 1 : 0;
+}
+
+/** @brief Apply the newest settings and build the next chunk of a new table
+ *	@returns 1 while a table is being built, 0 if otherwise
+ */
+uint8_t service_output(void)
+{
+	struct waveform_settings output;
+	
+	/* Only the newest snapshot is applied, once the sequence stops */
+	if (!sequencer_running() && settings_take(&output)) {
+		set_harmonics(output.harmonics, output.harmonic_count);
+		set_pulse_duty(output.duty);
+		generate_waveform(output.wave, output.frequency, output.amplitude, output.offset);
+	}
+	
+	/* A new table is built a chunk per pass, so input is served meanwhile */
+	return continue_generate();
+}
+
+/** @brief Keep the output going while a menu waits for a key
+ *
+ *	Menus block in getchar() and scanf(), the output would otherwise stay
+ *	held until a key is pressed if a table was being built.
+ */
+void wait_input(void)
+{
+	if (!service_output())
+		event_sleep();
+}
 
 /** @brief Draw blank screen in serial terminal
  */
@@ -67,14 +118,88 @@ void change_waveform(struct apptree_node *parent, int child_idx)
 		settings.wave = SAWTOOTH;
 		printf("Waveform changed to SAWTOOTH!\r\n");
 		break;
+	case HARMONIC:
+		settings.wave = HARMONIC;
+		printf("Waveform changed to HARMONIC!\r\n");
+		break;
+	case PULSE:
+		settings.wave = PULSE;
+		printf("Waveform changed to PULSE on PA6!\r\n");
+		break;
 	default:
 		return;
 	}
 	
+	if (settings.wave != PULSE && settings.frequency > get_max_freq()) {
+		settings.frequency = get_max_freq();
+		printf("Frequency limited to %d!\r\n", settings.frequency);
+	}
+	
 	printf("Press any key to continue ...\r\n");
 	getchar();
 	
-	settings.changed = true;
+	post_settings();
+}
+
+/** @brief update harmonic content of the harmonic waveform from user input
+ *	@param *parent parent structure of apptree menu
+ *	@param child_idx is not used
+ */
+void change_harmonics(struct apptree_node *parent, int child_idx)
+{
+	struct harmonic new_harmonics[MAX_HARMONICS];
+	unsigned int count;
+	unsigned int order;
+	unsigned int amp;
+	unsigned int phase;
+	int ret;
+	
+	print_blankscreen();
+	
+	printf("Enter up to %d harmonics as <order> <amplitude %%> <phase deg>\r\n", MAX_HARMONICS);
+	printf("Order 1 is the fundamental, maximum order is %d.\r\n", MAX_HARMONIC_ORDER);
+	printf("Enter order 0 to finish.\r\n");
+	printf("\r\n");
+	
+	count = 0;
+	while (count < MAX_HARMONICS) {
+		printf("Harmonic %d: ", count + 1);
+		
+		ret = scanf("%d", &order);
+		if (ret > 0 && order != 0)
+			ret = scanf("%d %d", &amp, &phase);
+		printf("\r\n");
+		
+		if (ret <= 0) {
+			printf("Error! Invalid input\r\n");
+			continue;
+		}
+		
+		if (order == 0)
+			break;
+		
+		if (order > MAX_HARMONIC_ORDER || amp > 100 || phase >= 360) {
+			printf("Error! Value out of range!\r\n");
+			continue;
+		}
+		
+		new_harmonics[count].order = order;
+		new_harmonics[count].amplitude = amp;
+		new_harmonics[count].phase = phase;
+		count++;
+	}
+	
+	if (count == 0) {
+		printf("No harmonics entered, content unchanged.\r\n");
+	} else {
+		memcpy(settings.harmonics, new_harmonics, sizeof(new_harmonics));
+		settings.harmonic_count = count;
+		post_settings();
+		printf("Harmonic content changed!\r\n");
+	}
+	
+	printf("Press any key to continue ...\r\n");
+	getchar();
 }
 
 /** @brief update waveform frequency from user input
@@ -89,7 +214,10 @@ void change_frequency(struct apptree_node *parent, int child_idx)
 	int ret;
 	
 	//max_freq = 2000;
-	max_freq = get_max_freq();
+	if (settings.wave == PULSE)
+		max_freq = get_max_pulse_freq();
+	else
+		max_freq = get_max_freq();
 	//min_freq = 1;
 	min_freq = get_min_freq();
 	
@@ -126,7 +254,7 @@ repeat:
 	getchar();
 	
 	settings.frequency = new_freq;
-	settings.changed = true;
+	post_settings();
 }
 
 /** @brief update waveform amplitude from user input
@@ -181,7 +309,535 @@ repeat:
 	getchar();
 	
 	settings.amplitude = new_amp;
-	settings.changed = true;
+	post_settings();
+}
+
+/** @brief update waveform DC offset from user input
+ *	@param *parent parent structure of apptree menu
+ *	@param child_idx is not used
+ */
+void change_offset(struct apptree_node *parent, int child_idx)
+{
+	float max_offset;
+	float min_offset;
+	float new_offset;
+	int ret;
+	
+	max_offset = get_max_offset();
+	min_offset = get_min_offset();
+	
+	print_blankscreen();
+	
+repeat:
+	printf("Current offset: %.1f\r\n", settings.offset);
+	printf("Maximum allowable offset: %.1f\r\n", max_offset);
+	printf("Minimum allowable offset: %.1f\r\n", min_offset);
+	printf("\r\n");
+	printf("Enter new offset: ");
+	
+	ret = scanf("%f", &new_offset);
+	printf("\r\n");
+	
+	if (ret <= 0) {
+		printf("Error! Invalid input\r\n");
+		printf("\r\n");
+		goto repeat;
+	}
+	
+	if (new_offset > max_offset) {
+		printf("Error! Value exceeded maximum limit!\r\n");
+		printf("\r\n");
+		goto repeat;
+	} else if (new_offset < min_offset) {
+		printf("Error! Value preceeded minimum limit!\r\n");
+		printf("\r\n");
+		goto repeat;
+	}
+	
+	/* Change new_offset to .1 precision */
+	new_offset = ((float)((int)(new_offset * 10)))/10;
+	
+	printf("Offset changed to %.1f!\r\n", new_offset);
+	if (new_offset + settings.amplitude > max_offset)
+		printf("Warning! Waveform peaks above %.1f will be clipped!\r\n", max_offset);
+	printf("Press any key to continue ...\r\n");
+	getchar();
+	
+	settings.offset = new_offset;
+	post_settings();
+}
+
+/** @brief update pulse duty cycle from user input
+ *	@param *parent parent structure of apptree menu
+ *	@param child_idx is not used
+ */
+void change_duty(struct apptree_node *parent, int child_idx)
+{
+	unsigned int new_duty;
+	int ret;
+	
+	print_blankscreen();
+	
+repeat:
+	printf("Current duty cycle: %d%%\r\n", settings.duty);
+	printf("Allowable duty cycle: 0 to 100%%\r\n");
+	printf("\r\n");
+	printf("Enter new duty cycle: ");
+	
+	ret = scanf("%d", &new_duty);
+	printf("\r\n");
+	
+	if (ret <= 0) {
+		printf("Error! Invalid input\r\n");
+		printf("\r\n");
+		goto repeat;
+	}
+	
+	if (new_duty > 100) {
+		printf("Error! Value exceeded maximum limit!\r\n");
+		printf("\r\n");
+		goto repeat;
+	}
+	
+	printf("Duty cycle changed to %d%%!\r\n", new_duty);
+	printf("Press any key to continue ...\r\n");
+	getchar();
+	
+	settings.duty = new_duty;
+	post_settings();
+}
+
+/** @brief change the gate time of the frequency meter
+ *	@param *parent parent structure of apptree menu
+ *	@param child_idx is not used
+ */
+void change_gate(struct apptree_node *parent, int child_idx)
+{
+	unsigned int new_gate;
+	int ret;
+	
+	print_blankscreen();
+	
+repeat:
+	printf("Current meter gate: %d ms\r\n", freqmeter_get_gate_ms());
+	printf("Allowable meter gate: %d to %d ms\r\n", FREQMETER_MIN_GATE_MS,
+		FREQMETER_MAX_GATE_MS);
+	printf("\r\n");
+	printf("Enter new meter gate: ");
+	
+	ret = scanf("%d", &new_gate);
+	printf("\r\n");
+	
+	if (ret <= 0) {
+		printf("Error! Invalid input\r\n");
+		printf("\r\n");
+		goto repeat;
+	}
+	
+	if (freqmeter_set_gate_ms(new_gate)) {
+		printf("Error! Value out of range!\r\n");
+		printf("\r\n");
+		goto repeat;
+	}
+	
+	printf("Meter gate changed to %d ms!\r\n", new_gate);
+	printf("Press any key to continue ...\r\n");
+	getchar();
+}
+
+/** @brief sequence menu entries, in the order the menu nodes are created */
+enum sequence_menu {
+	SEQUENCE_SHOW = 0,
+	SEQUENCE_ADD = 1,
+	SEQUENCE_CLEAR = 2,
+	SEQUENCE_LOOP = 3,
+	SEQUENCE_RUN = 4,
+	SEQUENCE_STOP = 5
+};
+
+/** @brief post a sequence end event to the main loop
+ *	@note called from the sequencer timer interrupt
+ */
+void post_sequence_end(void)
+{
+	event_post(EVENT_SEQUENCE_END);
+}
+
+/** @brief printout the steps of the sequence
+ */
+void print_sequence(void)
+{
+	const struct sequence_step *steps;
+	unsigned int count;
+	unsigned int i;
+	
+	count = sequencer_read_steps(&steps);
+	
+	printf("Sequence (%s):\r\n", sequencer_get_loop() ? "looping" : "single pass");
+	printf("\r\n");
+	
+	if (count == 0)
+		printf("\tNo steps\r\n");
+	
+	for (i = 0; i < count; i++)
+		printf("\t%d: wave %d, %d Hz, %.1f V, %d ms\r\n", i + 1, steps[i].wave,
+			steps[i].frequency, steps[i].amplitude, steps[i].duration_ms);
+	
+	printf("\r\n");
+	
+	if (sequencer_running())
+		printf("Playing step %d, longest step switch %d us\r\n",
+			sequencer_read_current_step() + 1, sequencer_read_max_transition_us());
+	else
+		printf("Stopped\r\n");
+}
+
+/** @brief read a step from user input and append it to the sequence
+ */
+void add_sequence_step(void)
+{
+	struct sequence_step step;
+	unsigned int wave;
+	int ret;
+	
+	printf("Waveforms: 0 SINE, 1 SAWTOOTH, 2 TRIANGLE, 3 SQUARE, 4 HARMONIC\r\n");
+	printf("Enter step as <waveform> <frequency> <amplitude> <duration ms>: ");
+	
+	ret = scanf("%d %d %f %d", &wave, &step.frequency, &step.amplitude, &step.duration_ms);
+	printf("\r\n");
+	
+	step.wave = (enum waveform)wave;
+	
+	if (ret < 4 || wave > HARMONIC || sequencer_add_step(&step)) {
+		printf("Error! Invalid step or sequence full\r\n");
+		return;
+	}
+	
+	printf("Step added!\r\n");
+}
+
+/** @brief handle the sequence menu
+ *	@param *parent parent structure of apptree menu
+ *	@param child_idx is the selected sequence menu entry
+ */
+void change_sequence(struct apptree_node *parent, int child_idx)
+{
+	print_blankscreen();
+	
+	switch (child_idx) {
+	case SEQUENCE_SHOW:
+		print_sequence();
+		break;
+	case SEQUENCE_ADD:
+		add_sequence_step();
+		break;
+	case SEQUENCE_CLEAR:
+		sequencer_clear();
+		printf("Sequence cleared!\r\n");
+		break;
+	case SEQUENCE_LOOP:
+		sequencer_set_loop(!sequencer_get_loop());
+		printf("Looping %s!\r\n", sequencer_get_loop() ? "enabled" : "disabled");
+		break;
+	case SEQUENCE_RUN:
+		if (sequencer_running()) {
+			printf("Sequence already running!\r\n");
+		} else if (sequencer_start(settings.offset, &post_sequence_end)) {
+			printf("Error! Sequence is empty or does not fit in memory\r\n");
+			post_settings();
+		} else {
+			printf("Sequence started!\r\n");
+		}
+		break;
+	case SEQUENCE_STOP:
+		if (sequencer_running()) {
+			sequencer_stop();
+			post_settings();
+		}
+		printf("Sequence stopped!\r\n");
+		break;
+	default:
+		return;
+	}
+	
+	printf("Press any key to continue ...\r\n");
+	getchar();
+}
+
+/** @brief trace menu entries, in the order the menu nodes are created */
+enum trace_menu {
+	TRACE_MENU_DUMP = 0,
+	TRACE_MENU_CLEAR = 1
+};
+
+/** @brief handle the trace menu
+ *	@param *parent parent structure of apptree menu
+ *	@param child_idx is the selected trace menu entry
+ *
+ *	The dump is binary, capture it to a file and decode it with
+ *	tools/trace_decode.
+ */
+void change_trace(struct apptree_node *parent, int child_idx)
+{
+	print_blankscreen();
+	
+	switch (child_idx) {
+	case TRACE_MENU_DUMP:
+		printf("Trace dump follows:\r\n");
+		screen_flush();
+		trace_dump();
+		screen_invalidate();
+		printf("\r\nTrace dump done!\r\n");
+		break;
+	case TRACE_MENU_CLEAR:
+		trace_clear();
+		printf("Trace cleared!\r\n");
+		break;
+	default:
+		return;
+	}
+	
+	printf("Press any key to continue ...\r\n");
+	getchar();
+}
+
+/** @brief preset menu entries, in the order the menu nodes are created */
+enum preset_menu {
+	PRESET_MENU_SHOW = 0,
+	PRESET_MENU_SAVE = 1,
+	PRESET_MENU_RECALL = 2,
+	PRESET_MENU_DEFAULT = 3
+};
+
+/** @brief play a preset without building its table again
+ *	@param index is the preset number
+ *	@return 0 if the preset is played, -1 if the preset is empty
+ *
+ *	The preset replaces the settings. A snapshot posted but not applied yet
+ *	is dropped, it would otherwise build a table over the preset.
+ */
+int recall_preset(unsigned int index)
+{
+	struct waveform_settings stored;
+	struct waveform_slot slot;
+	
+	if (preset_load(index, &stored, &slot))
+		return -1;
+	
+	trace_event(TRACE_PRESET, index);
+	settings = stored;
+	
+	set_harmonics(settings.harmonics, settings.harmonic_count);
+	set_pulse_duty(settings.duty);
+	
+	/* A pulse or a preset saved without a table is set up as usual */
+	if (slot.noofsample == 0 || settings.wave == PULSE) {
+		post_settings();
+		return 0;
+	}
+	
+	settings_discard();
+	restore_waveform(&slot);
+	return 0;
+}
+
+/** @brief start the output at boot without building a table
+ *
+ *	The last preset is played from flash, or else the default table. The
+ *	settings are only posted to build a table if neither can be played.
+ */
+void start_output(void)
+{
+	uint32_t preset;
+	
+	if (preset_read_last(&preset) == 0 && recall_preset(preset) == 0)
+		return;
+	
+	if (play_default_waveform())
+		return;
+	
+	post_settings();
+}
+
+/** @brief read a preset number from user input
+ *	@return preset number from 0, -1 if the input is invalid
+ */
+int read_preset_number(void)
+{
+	unsigned int number;
+	int ret;
+	
+	printf("Enter preset number (1 to %d): ", PRESET_COUNT);
+	ret = scanf("%d", &number);
+	printf("\r\n");
+	
+	if (ret <= 0 || number < 1 || number > PRESET_COUNT) {
+		printf("Error! Invalid preset number\r\n");
+		return -1;
+	}
+	
+	return number - 1;
+}
+
+/** @brief printout the presets
+ */
+void print_presets(void)
+{
+	struct waveform_settings stored;
+	struct waveform_slot slot;
+	unsigned int i;
+	
+	printf("Presets:\r\n");
+	printf("\r\n");
+	
+	for (i = 0; i < PRESET_COUNT; i++) {
+		if (preset_load(i, &stored, &slot))
+			printf("\t%d: empty\r\n", i + 1);
+		else
+			printf("\t%d: wave %d, %d Hz, %.1f V, %.1f V offset, %d samples\r\n",
+				i + 1, stored.wave, stored.frequency, stored.amplitude,
+				stored.offset, slot.noofsample);
+	}
+}
+
+/** @brief handle the preset menu
+ *	@param *parent parent structure of apptree menu
+ *	@param child_idx is the selected preset menu entry
+ *
+ *	The last preset saved or recalled is restored at the next boot.
+ */
+void change_preset(struct apptree_node *parent, int child_idx)
+{
+	struct waveform_slot slot;
+	int index;
+	
+	print_blankscreen();
+	
+	switch (child_idx) {
+	case PRESET_MENU_SHOW:
+		print_presets();
+		break;
+	case PRESET_MENU_SAVE:
+		index = read_preset_number();
+		if (index < 0)
+			break;
+		
+		/* The table played while a new one is built is that of older
+		 * settings, the preset then keeps the settings alone */
+		if (sequencer_running()) {
+			printf("Error! Stop the sequence first\r\n");
+		} else if (preset_save(index, &settings,
+				((get_generate_progress() == 100) &&
+				get_playing_waveform(&slot)) ? &slot : NULL)) {
+			printf("Error! Preset %d cannot be saved while it is played\r\n", index + 1);
+		} else {
+			preset_set_last(index);
+			printf("Preset %d saved!\r\n", index + 1);
+		}
+		break;
+	case PRESET_MENU_RECALL:
+		index = read_preset_number();
+		if (index < 0)
+			break;
+		
+		if (sequencer_running()) {
+			printf("Error! Stop the sequence first\r\n");
+		} else if (recall_preset(index)) {
+			printf("Error! Preset %d is empty\r\n", index + 1);
+		} else {
+			preset_set_last(index);
+			printf("Preset %d recalled!\r\n", index + 1);
+		}
+		break;
+	case PRESET_MENU_DEFAULT:
+		preset_set_last(PRESET_NONE);
+		printf("Default settings will be used at boot!\r\n");
+		break;
+	default:
+		return;
+	}
+	
+	printf("Press any key to continue ...\r\n");
+	getchar();
+}
+
+/** @brief baud rate menu entries, in the order the menu nodes are created */
+enum baud_menu {
+	BAUD_MENU_115200 = 0,
+	BAUD_MENU_921600 = 1,
+	BAUD_MENU_3000000 = 2
+};
+
+/** Time given to confirm a new baud rate before going back, in ms */
+#define BAUD_CONFIRM_MS		10000
+
+/** @brief handle the baud rate menu
+ *	@param *parent parent structure of apptree menu
+ *	@param child_idx selects the new baud rate
+ *
+ *	The terminal has to be switched to the new baud rate by hand. If no key
+ *	arrives at the new baud rate in time the old one is restored, so a
+ *	terminal which cannot follow is not locked out.
+ */
+void change_baud(struct apptree_node *parent, int child_idx)
+{
+	struct baud_setting old;
+	unsigned char ch;
+	uint32_t start;
+	uint32_t events = 0;
+	int baud;
+	
+	switch (child_idx) {
+	case BAUD_MENU_115200:
+		baud = 115200;
+		break;
+	case BAUD_MENU_921600:
+		baud = 921600;
+		break;
+	case BAUD_MENU_3000000:
+		baud = 3000000;
+		break;
+	default:
+		return;
+	}
+	
+	print_blankscreen();
+	serial_read_baud(&old);
+	
+	printf("Switching to %d baud, change the terminal and press any key.\r\n", baud);
+	printf("Back to %d baud after %d s without a key.\r\n", old.actual,
+		BAUD_CONFIRM_MS / 1000);
+	screen_flush();
+	
+	if (serial_set_baud(baud)) {
+		printf("Error! %d baud cannot be produced from %d Hz\r\n", baud,
+			SystemCoreClock);
+	} else {
+		/* The terminal shows garbage while it is on the wrong baud rate */
+		screen_invalidate();
+		
+		/* Keep building a new table and sleep between ticks, the events are
+		 * kept for the main loop */
+		start = systick_get_ms();
+		while (serial_getchar_nonblocking(&ch)) {
+			if (systick_get_ms() - start >= BAUD_CONFIRM_MS) {
+				serial_set_baud(old.actual);
+				break;
+			}
+			if (!service_output()) {
+				events |= event_take();
+				event_wait();
+			}
+		}
+		event_post(events);
+		
+		print_blankscreen();
+		serial_read_baud(&old);
+		printf("Baud rate is %d (%d ppm error)\r\n", old.actual, old.error_ppm);
+	}
+	
+	printf("Press any key to continue ...\r\n");
+	getchar();
 }
 
 /** @brief printout waveform setting status
@@ -190,6 +846,16 @@ repeat:
  */
 void print_status(struct apptree_node *parent, int child_idx)
 {
+	struct event_stats stats;
+	struct arena_stats memory;
+	struct settings_stats mailbox;
+	struct screen_stats screen;
+	struct baud_setting baud;
+	struct preset_stats presets;
+	struct waveform_slot slot;
+	struct freqmeter_result measured;
+	unsigned int i;
+	
 	print_blankscreen();
 	
 	printf("Current system settings are as follows:\r\n");
@@ -212,17 +878,102 @@ void print_status(struct apptree_node *parent, int child_idx)
 		settings.wave = SAWTOOTH;
 		printf("\tWaveform:\tSAWTOOTH\r\n");
 		break;
+	case HARMONIC:
+		printf("\tWaveform:\tHARMONIC\r\n");
+		for (i = 0; i < settings.harmonic_count; i++)
+			printf("\t\t\tH%d %d%% %d deg\r\n", settings.harmonics[i].order,
+				settings.harmonics[i].amplitude, settings.harmonics[i].phase);
+		break;
+	case PULSE:
+		printf("\tWaveform:\tPULSE\r\n");
+		printf("\tDuty cycle:\t%d%%\r\n", settings.duty);
+		break;
 	default:
 		return;
 	}
 	
 	printf("\tFrequency:\t%d\r\n", settings.frequency);
 	printf("\tAmplitude:\t%.1f\r\n", settings.amplitude);
+	printf("\tOffset:\t\t%.1f\r\n", settings.offset);
+	printf("\tClipped:\t%d samples\r\n", get_clipped_samples());
+	if (get_generate_progress() < 100)
+		printf("\tBuild time:\tbuilding, %d%% done, %s\r\n",
+			get_generate_progress(), get_output_held() ? "output held" :
+			"old table playing");
+	else
+		printf("\tBuild time:\t%d us\r\n", get_table_build_time_us());
+	printf("\tReconfigure:\t%d core clocks, %d changes without a new table\r\n",
+		get_dac_config_cycles(), get_retimed_changes());
+	printf("\tTable:\t\t%d cycles, %d ppb error\r\n", get_table_cycles(),
+		get_frequency_error_ppb());
+	if (get_playing_waveform(&slot))
+		printf("\tPlan:\t\t%d samples per cycle, %d bit, %d S/s, %d.%d%% DMA load\r\n",
+			slot.noofsample / slot.cycles, slot.size == DMA_DATA_8BIT ? 8 : 12,
+			get_sample_rate(), get_dma_load_permille() / 10,
+			get_dma_load_permille() % 10);
+	/* The deviation is from the table played, which may be a sequence step
+	 * or older than the settings shown */
+	if (!get_playing_waveform(&slot) || freqmeter_read(slot.frequency, &measured))
+		printf("\tMeasured:\tnot measured\r\n");
+	else
+		printf("\tMeasured:\t%d.%03d Hz, %d S/s, %d ppm deviation\r\n",
+			measured.frequency_mhz / 1000, measured.frequency_mhz % 1000,
+			measured.sample_rate, measured.error_ppm);
+	if (get_underrun_count())
+		printf("\tUnderruns:\t%d, last at %d ms (now %d ms)\r\n",
+			get_underrun_count(), get_last_underrun_ms(), systick_get_ms());
+	else
+		printf("\tUnderruns:\t0\r\n");
+	
+	settings_read_stats(&mailbox);
+	printf("\tSettings:\t%d posted, %d applied, %d coalesced, %d discarded, "
+		"%d cancelled\r\n", mailbox.posted, mailbox.taken, mailbox.coalesced,
+		mailbox.discarded, get_cancelled_builds());
+	printf("\r\n");
+	
+	event_read_stats(&stats);
+	printf("\tIdle:\t\t%d%% of last %d ms\r\n", stats.idle_percent, stats.window_ms);
+	printf("\tWake ups:\t%d (%d with events)\r\n", stats.wakes, stats.event_wakes);
+	
+	arena_read_stats(&memory);
+	printf("\tArena:\t\t%d of %d bytes in %d blocks, %d largest free\r\n",
+		memory.used, memory.size, memory.blocks, memory.largest_free);
+	printf("\tArena peak:\t%d bytes used, %d bytes reached, %d failed\r\n",
+		memory.peak_used, memory.peak_end, memory.failed);
+	
+	printf("\tBoot:\t\toutput at %d us, menu at %d us after clock setup\r\n",
+		boot_output_us, boot_menu_us);
+	
+	preset_read_stats(&presets);
+	if (presets.last == PRESET_NONE)
+		printf("\tPresets:\t%d of %d saved, defaults at boot\r\n",
+			presets.saved, PRESET_COUNT);
+	else
+		printf("\tPresets:\t%d of %d saved, preset %d at boot\r\n",
+			presets.saved, PRESET_COUNT, presets.last + 1);
+	printf("\tPreset log:\t%d of %d records used\r\n", presets.log_used,
+		PRESET_LOG_RECORDS);
+	
+	serial_read_baud(&baud);
+	printf("\tBaud rate:\t%d (%d ppm error, oversampling by %d)\r\n",
+		baud.actual, baud.error_ppm, baud.over8 ? 8 : 16);
+	
+	screen_read_stats(&screen);
+	printf("\tScreen:\t\t%d of %d bytes sent last screen, %d of %d in total\r\n",
+		screen.last_sent, screen.last_written, screen.sent, screen.written);
 	printf("\r\n");
 	printf("Press any key to continue ...\r\n");
 	getchar();
 }
 
+/** @brief post a serial receive event to the main loop
+ *	@note called from the USART2 interrupt
+ */
+void post_serial_rx(void)
+{
+	event_post(EVENT_SERIAL_RX);
+}
+
 /** @brief read serial input from user
  *	@param *input point to user input key
  *	@return 0 = read sucess -1 = read failed
@@ -269,6 +1020,8 @@ void SystemCoreClockConfigure(void)
 int main (void)
 {
 	struct apptree_keybindings keys;
+	uint32_t events;
+	uint8_t building;
 	
 	struct apptree_node *n_master;
 	
@@ -276,16 +1029,50 @@ int main (void)
 	struct apptree_node *n_frequency;
 	struct apptree_node *n_amplitude;
 	struct apptree_node *n_status;
+	struct apptree_node *n_gate;
 	
 	struct apptree_node *n_sine;
 	struct apptree_node *n_square;
 	struct apptree_node *n_triangle;
 	struct apptree_node *n_sawtooth;
+	struct apptree_node *n_harmonic;
+	struct apptree_node *n_harmonics;
+	struct apptree_node *n_pulse;
+	struct apptree_node *n_duty;
+	struct apptree_node *n_offset;
+	struct apptree_node *n_sequence;
+	struct apptree_node *n_seq_show;
+	struct apptree_node *n_seq_add;
+	struct apptree_node *n_seq_clear;
+	struct apptree_node *n_seq_loop;
+	struct apptree_node *n_seq_run;
+	struct apptree_node *n_seq_stop;
+	struct apptree_node *n_trace;
+	struct apptree_node *n_trace_dump;
+	struct apptree_node *n_trace_clear;
+	struct apptree_node *n_preset;
+	struct apptree_node *n_preset_show;
+	struct apptree_node *n_preset_save;
+	struct apptree_node *n_preset_recall;
+	struct apptree_node *n_preset_default;
+	struct apptree_node *n_baud;
+	struct apptree_node *n_baud_115200;
+	struct apptree_node *n_baud_921600;
+	struct apptree_node *n_baud_3000000;
 	
 	SystemCoreClockConfigure();                 /* Configure HSI as System Clock */
 	SystemCoreClockUpdate();
 	
+	/* The output comes first, the menu is set up while it plays */
+	systick_init();
+	start_output();
+	boot_output_us = systick_get_cycles() / systick_cycles_per_us();
+	
+	event_init();
+	
 	serial_init(115200);
+	serial_set_rx_callback(&post_serial_rx);
+	screen_init();
 	
 	keys.up		= 'i';
 	keys.down 	= 'k';
@@ -298,22 +1085,69 @@ int main (void)
 	apptree_create_node(&n_waveform, n_master, "Waveform", "Change output waveform", NULL);
 	apptree_create_node(&n_frequency, n_master, "Frequency", "Change output frequency", &change_frequency);
 	apptree_create_node(&n_amplitude, n_master, "Amplitude", "Change output amplitude", &change_amplitude);
+	apptree_create_node(&n_offset, n_master, "Offset", "Change output DC offset", &change_offset);
+	apptree_create_node(&n_harmonics, n_master, "Harmonics", "Change harmonic content", &change_harmonics);
+	apptree_create_node(&n_duty, n_master, "Duty cycle", "Change pulse duty cycle", &change_duty);
+	apptree_create_node(&n_sequence, n_master, "Sequence", "Play waveform steps back to back", NULL);
+	apptree_create_node(&n_trace, n_master, "Trace", "Dump or clear the event trace", NULL);
+	apptree_create_node(&n_preset, n_master, "Presets", "Save or recall settings in flash", NULL);
+	apptree_create_node(&n_baud, n_master, "Baud rate", "Change the serial baud rate", NULL);
+	apptree_create_node(&n_gate, n_master, "Meter gate", "Change the frequency meter gate time", &change_gate);
 	apptree_create_node(&n_status, n_master, "Status", "View system status", &print_status);
 	
 	apptree_create_node(&n_sine, n_waveform, "Sine", "Change to sine wave", &change_waveform);
 	apptree_create_node(&n_square, n_waveform, "Sawtooth", "Change to square wave", &change_waveform);
 	apptree_create_node(&n_triangle, n_waveform, "Triangle", "Change to triangle wave", &change_waveform);
 	apptree_create_node(&n_sawtooth, n_waveform, "Square", "Change to sawtooth wave", &change_waveform);
+	apptree_create_node(&n_harmonic, n_waveform, "Harmonic", "Change to harmonic wave", &change_waveform);
+	apptree_create_node(&n_pulse, n_waveform, "Pulse", "Change to pulse output on PA6", &change_waveform);
+	
+	apptree_create_node(&n_seq_show, n_sequence, "Show", "Show sequence steps", &change_sequence);
+	apptree_create_node(&n_seq_add, n_sequence, "Add step", "Append a step", &change_sequence);
+	apptree_create_node(&n_seq_clear, n_sequence, "Clear", "Remove all steps", &change_sequence);
+	apptree_create_node(&n_seq_loop, n_sequence, "Loop", "Toggle looping", &change_sequence);
+	apptree_create_node(&n_seq_run, n_sequence, "Run", "Start the sequence", &change_sequence);
+	apptree_create_node(&n_seq_stop, n_sequence, "Stop", "Stop the sequence", &change_sequence);
+	
+	apptree_create_node(&n_trace_dump, n_trace, "Dump", "Send the trace in binary", &change_trace);
+	apptree_create_node(&n_trace_clear, n_trace, "Clear", "Remove all trace records", &change_trace);
+	
+	apptree_create_node(&n_preset_show, n_preset, "Show", "Show saved presets", &change_preset);
+	apptree_create_node(&n_preset_save, n_preset, "Save", "Save the output to a preset", &change_preset);
+	apptree_create_node(&n_preset_recall, n_preset, "Recall", "Play a saved preset", &change_preset);
+	apptree_create_node(&n_preset_default, n_preset, "Boot default", "Start with the defaults", &change_preset);
+	
+	apptree_create_node(&n_baud_115200, n_baud, "115200", "Default baud rate", &change_baud);
+	apptree_create_node(&n_baud_921600, n_baud, "921600", "Fast baud rate", &change_baud);
+	apptree_create_node(&n_baud_3000000, n_baud, "3000000", "Fastest baud rate at 48 MHz", &change_baud);
+	
+	set_generate_abort(&generate_superseded);
+	serial_set_idle_callback(&wait_input);
 	
 	apptree_enable();
+	boot_menu_us = systick_get_cycles() / systick_cycles_per_us();
 	
 	while (1){
-		apptree_handle_input();
-		if(settings.changed==true)
-		{
-			generate_waveform(settings.wave, settings.frequency, settings.amplitude);
-			settings.changed=false;
+		events = event_take();
+		
+		if (events & EVENT_SERIAL_RX) {
+			while (serial_rx_pending())
+				apptree_handle_input();
+		}
+		
+		/* Give the tables of an ended sequence back to the arena */
+		if (events & EVENT_SEQUENCE_END) {
+			if (!sequencer_running())
+				sequencer_stop();
+			post_settings();
 		}
+		
+		building = service_output();
+		
+		/* Sleep until the next interrupt, unless a table is being built */
+		screen_flush();
+		if (!building)
+			event_wait();
 	}
 	
 	
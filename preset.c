@@ -0,0 +1,298 @@
+
+/** @file preset.c
+ *  @brief Flash presets
+ *
+ *	Keeps PRESET_COUNT output settings in flash together with the sample
+ *	table that was played for them and its timer values. Loading a preset
+ *	gives a slot whose table points into flash, so it is played by the DMA
+ *	straight from there without building it again.
+ *
+ *	Each slot takes PRESET_SLOT_SIZE bytes: a header followed by the table.
+ *	Saving erases the slot, programs the table and the header and programs
+ *	the header magic last, so a slot cut short by a reset reads as empty.
+ *	A slot is only written when saved by hand.
+ *
+ *	The preset to restore at boot changes with every save and recall, so it
+ *	is kept in a log of PRESET_LOG_PAGES pages instead. Each change appends a
+ *	record to the active page and a page is only erased once full, when the
+ *	log moves to the other page. The new record is written to the other page
+ *	before the full one is erased, so the log is never empty. Both pages then
+ *	wear evenly at one erase per PRESET_LOG_RECORDS changes.
+ */
+
+#include <string.h>
+#include "preset.h"
+#include "trace.h"
+
+/** Magic of a complete preset header, changed with the header layout so
+ *	presets of an older layout read as empty */
+#define PRESET_MAGIC			0x32455250ul	/* "PRE2" */
+
+/** Log record, the preset number with a check in the upper halfword */
+#define PRESET_LOG_TAG			0x5A00ul
+#define PRESET_LOG_RECORD(__IDX)	(((~(PRESET_LOG_TAG | (__IDX)) & 0xFFFFul) << 16) | PRESET_LOG_TAG | (__IDX))
+
+/** Header of a preset slot in flash, the table follows it */
+struct preset_header {
+	struct waveform_settings settings;
+	uint32_t noofsample;		/** Samples in the table, 0 if settings only */
+	uint32_t cycles;
+	int32_t error_ppb;
+	uint32_t size;				/** enum dma_data_size of the table */
+	uint32_t timer_count;
+	uint32_t timer_prescalar;
+	uint32_t rotation;
+	uint32_t magic;				/** PRESET_MAGIC, programmed last */
+};
+
+/** @brief Gives the header of a preset slot.
+ *	@param index The preset number.
+ *	@returns Pointer to the header in flash.
+ */
+static const struct preset_header *preset_header(uint32_t index)
+{
+	return (const struct preset_header *)(PRESET_SLOT_BASE +
+		index * PRESET_SLOT_SIZE);
+}
+
+/** @brief Gives the number of bytes of a table.
+ *	@param noofsample Samples in the table.
+ *	@param size Data path of the table.
+ *	@returns Bytes used by the table.
+ */
+static uint32_t preset_table_bytes(uint32_t noofsample, uint32_t size)
+{
+	if (size == DMA_DATA_8BIT)
+		return ((noofsample + 3) / 4) * 4;
+
+	return noofsample * 4;
+}
+
+/** @brief Saves a preset.
+ *	@param index The preset number.
+ *	@param settings The settings to keep.
+ *	@param slot The table played for the settings, NULL to keep the settings
+ *	only. Its table must point to the samples, which may be in the arena or
+ *	in another preset.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Takes about 200 ms. Code and DMA reading flash stall meanwhile, which may
+ *	cause a DAC underrun.
+ */
+int preset_save(uint32_t index, const struct waveform_settings *settings,
+			const struct waveform_slot *slot)
+{
+	struct preset_header header;
+	uint32_t base;
+	uint32_t bytes = 0;
+	uint32_t magic = PRESET_MAGIC;
+	uint32_t table;
+	uint32_t i;
+
+	if (index >= PRESET_COUNT)
+		return -1;
+
+	base = PRESET_SLOT_BASE + index * PRESET_SLOT_SIZE;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(&header.settings, settings, sizeof(header.settings));
+
+	if (slot != NULL) {
+		bytes = preset_table_bytes(slot->noofsample, slot->size);
+		if ((slot->table == NULL) || (bytes > PRESET_SLOT_SIZE - sizeof(header)))
+			return -1;
+
+		/* The table would be erased before it is copied */
+		table = (uint32_t)slot->table;
+		if ((table >= base) && (table < base + PRESET_SLOT_SIZE))
+			return -1;
+
+		header.noofsample = slot->noofsample;
+		header.cycles = slot->cycles;
+		header.error_ppb = slot->error_ppb;
+		header.size = slot->size;
+		header.timer_count = slot->timer_count;
+		header.timer_prescalar = slot->timer_prescalar;
+		header.rotation = slot->rotation;
+	}
+
+	for (i = 0; i < PRESET_SLOT_SIZE; i += FLASH_PAGE_SIZE) {
+		if (flash_erase_page(base + i))
+			return -1;
+	}
+
+	if (bytes && flash_program(base + sizeof(header), slot->table, bytes))
+		return -1;
+	if (flash_program(base, &header, sizeof(header) - sizeof(magic)))
+		return -1;
+	if (flash_program(base + sizeof(header) - sizeof(magic), &magic, sizeof(magic)))
+		return -1;
+
+	trace_event(TRACE_PRESET, (1ul << 23) | index);
+	return 0;
+}
+
+/** @brief Loads a preset.
+ *	@param index The preset number.
+ *	@param settings Container for the settings.
+ *	@param slot Container for the table and its timing. The table points
+ *	into flash and noofsample is 0 if the preset keeps the settings only.
+ *	@returns 0 if successful and -1 if the slot is empty.
+ */
+int preset_load(uint32_t index, struct waveform_settings *settings,
+			struct waveform_slot *slot)
+{
+	const struct preset_header *header;
+
+	if (index >= PRESET_COUNT)
+		return -1;
+
+	header = preset_header(index);
+	if (header->magic != PRESET_MAGIC)
+		return -1;
+
+	if (preset_table_bytes(header->noofsample, header->size) >
+		PRESET_SLOT_SIZE - sizeof(*header))
+		return -1;
+
+	memcpy(settings, &header->settings, sizeof(*settings));
+
+	slot->handle = -1;
+	slot->noofsample = header->noofsample;
+	slot->cycles = header->cycles;
+	slot->error_ppb = header->error_ppb;
+	slot->frequency = header->settings.frequency;
+	slot->size = (enum dma_data_size)header->size;
+	slot->timer_count = header->timer_count;
+	slot->timer_prescalar = header->timer_prescalar;
+	slot->rotation = header->rotation;
+	slot->table = (const uint32_t *)(header + 1);
+
+	return 0;
+}
+
+/** @brief Counts the records of a log page.
+ *	@param page The log page.
+ *	@returns Number of words programmed from the start of the page.
+ */
+static uint32_t preset_log_count(uint32_t page)
+{
+	const uint32_t *log = (const uint32_t *)(PRESET_LOG_BASE + page * FLASH_PAGE_SIZE);
+	uint32_t count;
+
+	for (count = 0; count < PRESET_LOG_RECORDS; count++) {
+		if (log[count] == FLASH_ERASED_WORD)
+			break;
+	}
+
+	return count;
+}
+
+/** @brief Finds the active log page.
+ *	@param count Container for the number of records of the page.
+ *	@returns The active page.
+ *
+ *	A full page next to a page with records is the page the log moved away
+ *	from, left behind by a reset before it was erased.
+ */
+static uint32_t preset_log_active(uint32_t *count)
+{
+	uint32_t count0 = preset_log_count(0);
+	uint32_t count1 = preset_log_count(1);
+
+	if ((count1 != 0) && ((count0 == 0) || (count0 == PRESET_LOG_RECORDS))) {
+		*count = count1;
+		return 1;
+	}
+
+	*count = count0;
+	return 0;
+}
+
+/** @brief Sets the preset to restore at boot.
+ *	@param index The preset number, PRESET_NONE for the boot defaults.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Nothing is written if the preset is already the one to restore.
+ */
+int preset_set_last(uint32_t index)
+{
+	uint32_t record = PRESET_LOG_RECORD(index);
+	uint32_t last = PRESET_NONE;
+	uint32_t page;
+	uint32_t other;
+	uint32_t count;
+
+	if ((index >= PRESET_COUNT) && (index != PRESET_NONE))
+		return -1;
+
+	preset_read_last(&last);
+	if (last == index)
+		return 0;
+
+	page = preset_log_active(&count);
+	if (count < PRESET_LOG_RECORDS)
+		return flash_program(PRESET_LOG_BASE + page * FLASH_PAGE_SIZE +
+			count * 4, &record, sizeof(record));
+
+	/* Move to the other page, then retire the full one */
+	other = page ^ 1;
+	if (preset_log_count(other) != 0) {
+		if (flash_erase_page(PRESET_LOG_BASE + other * FLASH_PAGE_SIZE))
+			return -1;
+	}
+	if (flash_program(PRESET_LOG_BASE + other * FLASH_PAGE_SIZE, &record,
+		sizeof(record)))
+		return -1;
+
+	return flash_erase_page(PRESET_LOG_BASE + page * FLASH_PAGE_SIZE);
+}
+
+/** @brief Reads the preset to restore at boot.
+ *	@param index Container for the preset number.
+ *	@returns 0 if a preset is to be restored and -1 if otherwise.
+ *
+ *	Records cut short by a reset fail their check and are skipped.
+ */
+int preset_read_last(uint32_t *index)
+{
+	const uint32_t *log;
+	uint32_t page;
+	uint32_t count;
+	uint32_t record;
+
+	page = preset_log_active(&count);
+	log = (const uint32_t *)(PRESET_LOG_BASE + page * FLASH_PAGE_SIZE);
+
+	while (count) {
+		record = log[--count];
+		if ((record & 0xFF00) != PRESET_LOG_TAG)
+			continue;
+		if (record != PRESET_LOG_RECORD(record & 0xFF))
+			continue;
+
+		*index = record & 0xFF;
+		return (*index < PRESET_COUNT) ? 0 : -1;
+	}
+
+	return -1;
+}
+
+/** @brief Reads the state of the presets.
+ *	@param stats Container for the state.
+ */
+void preset_read_stats(struct preset_stats *stats)
+{
+	uint32_t i;
+
+	stats->saved = 0;
+	for (i = 0; i < PRESET_COUNT; i++) {
+		if (preset_header(i)->magic == PRESET_MAGIC)
+			stats->saved++;
+	}
+
+	if (preset_read_last(&stats->last))
+		stats->last = PRESET_NONE;
+
+	preset_log_active(&stats->log_used);
+}
@@ -0,0 +1,47 @@
+
+/** @file preset.h
+ *  @brief Flash presets include file
+ */
+
+#ifndef PRESET_H
+#define PRESET_H
+
+#include <stdint.h>
+#include "flash.h"
+#include "settings.h"
+
+/** Number of preset slots */
+#define PRESET_COUNT			4
+
+/** Preset number of the log meaning the boot defaults */
+#define PRESET_NONE				0xFF
+
+/** Flash kept for the presets, the last 36 KB of the 128 KB flash. The
+ *	linker must not place code there, see IROM1 in the project. */
+#define PRESET_FLASH_BASE		0x08017000ul
+#define PRESET_LOG_PAGES		2
+#define PRESET_LOG_BASE			PRESET_FLASH_BASE
+#define PRESET_SLOT_SIZE		(4 * FLASH_PAGE_SIZE)
+#define PRESET_SLOT_BASE		(PRESET_LOG_BASE + PRESET_LOG_PAGES * FLASH_PAGE_SIZE)
+
+/** Number of records a log page holds */
+#define PRESET_LOG_RECORDS		(FLASH_PAGE_SIZE / 4)
+
+/** State of the presets */
+struct preset_stats {
+	uint32_t saved;			/** Slots holding a preset */
+	uint32_t last;			/** Preset restored at boot, PRESET_NONE if none */
+	uint32_t log_used;		/** Records in the active log page */
+};
+
+int preset_save(uint32_t index, const struct waveform_settings *settings,
+			const struct waveform_slot *slot);
+int preset_load(uint32_t index, struct waveform_settings *settings,
+			struct waveform_slot *slot);
+
+int preset_set_last(uint32_t index);
+int preset_read_last(uint32_t *index);
+
+void preset_read_stats(struct preset_stats *stats);
+
+#endif	/* PRESET_H */
@@ -0,0 +1,104 @@
+
+/** @file pwm.c
+ *  @brief PWM pulse output driver
+ *
+ *	Timer 3 channel 1 is used in PWM mode 1 to drive pin PA6. Once started the
+ *	pulse train is produced entirely by the timer without any DMA or CPU
+ *	involvement. Both ARR and CCR1 are preloaded so changes take effect at the
+ *	end of the current period without glitches.
+ */
+
+#include "pwm.h"
+
+/**	@brief Initializes Timer 3 channel 1 for PWM output on PA6.
+ *	@returns Returns 0 if successful and -1 if otherwise.
+ */
+int pwm_init(void)
+{
+	/* Enable clock for GPIOA and Timer 3 */
+	RCC->AHBENR |= RCC_AHBENR_GPIOAEN;
+	RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
+	
+	/* Configure PA6 as TIM3_CH1 (AF1) */
+	GPIOA->AFR[0] &= ~(15ul << 4* 6);
+	GPIOA->AFR[0] |=  ( 1ul << 4* 6);
+	GPIOA->MODER  &= ~(GPIO_MODER_MODER6);
+	GPIOA->MODER  |=  ( 2ul << 2* 6);
+	GPIOA->OSPEEDR |= ( 3ul << 2* 6);	/* High speed for fast edges */
+	
+	/* Enable ARR register buffering, upcounting, continuous */
+	TIM3->CR1 = TIM_CR1_ARPE;
+	
+	/* PWM mode 1 with CCR1 preload, output forced low until enabled */
+	TIM3->CCMR1 &= ~(TIM_CCMR1_OC1M);
+	TIM3->CCMR1 |= TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1PE;
+	TIM3->CCER |= TIM_CCER_CC1E;
+	
+	return 0;
+}
+
+/** @brief Writes the frequency and duty cycle of the pulse train.
+ *	@param frequency The pulse frequency in Hz.
+ *	@param duty The duty cycle in percent.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The prescaler is kept as small as possible to give the finest duty cycle
+ *	resolution the frequency allows.
+ */
+int pwm_write_frequency(uint32_t frequency, uint32_t duty)
+{
+	uint32_t ticks;
+	uint32_t prescaler;
+	uint32_t period;
+	
+	if ((frequency == 0) || (duty > 100))
+		return -1;
+	
+	ticks = SystemCoreClock / frequency;
+	if (ticks < 2)
+		return -1;
+	
+	prescaler = (ticks - 1) / 65536;
+	period = ticks / (prescaler + 1);
+	
+	TIM3->PSC = prescaler;
+	TIM3->ARR = period - 1;
+	TIM3->CCR1 = (period * duty) / 100;
+	
+	return 0;
+}
+
+/** @brief Stops the pulse train and drives PA6 low.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int pwm_disable(void)
+{
+	TIM3->CR1 &= ~(TIM_CR1_CEN);
+	
+	/* Force output inactive */
+	TIM3->CCMR1 &= ~(TIM_CCMR1_OC1M);
+	TIM3->CCMR1 |= TIM_CCMR1_OC1M_2;
+	
+	return 0;
+}
+
+/** @brief Starts the pulse train.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Calling this on a running pulse train leaves the counter untouched so a
+ *	new frequency takes over at the end of the current period.
+ */
+int pwm_enable(void)
+{
+	/* Load the preloaded registers before starting */
+	if (!(TIM3->CR1 & TIM_CR1_CEN))
+		TIM3->EGR = TIM_EGR_UG;
+	
+	/* PWM mode 1 */
+	TIM3->CCMR1 &= ~(TIM_CCMR1_OC1M);
+	TIM3->CCMR1 |= TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1;
+	
+	TIM3->CR1 |= TIM_CR1_CEN;
+	
+	return 0;
+}
@@ -0,0 +1,18 @@
+
+/** @file pwm.h
+ *  @brief PWM pulse output driver include file
+ */
+
+#ifndef PWM_H
+#define PWM_H
+
+#include "stm32f0xx.h"
+
+int pwm_init(void);
+
+int pwm_write_frequency(uint32_t frequency, uint32_t duty);
+
+int pwm_disable(void);
+int pwm_enable(void);
+
+#endif	/* PWM_H */
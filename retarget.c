@@ -1,13 +1,25 @@
 
 /** @file retarget.c
  *  @brief Retarget stdio
+ *
+ *	Output goes through the screen layer. The ARM library calls fputc() once
+ *	per character of printf(), which the screen layer collects into lines,
+ *	while fputs(), puts() and fwrite() hand over the whole string at once.
+ *	Built with GCC and newlib, everything written to stdout reaches _write()
+ *	in blocks.
+ *
  *  @author Dennis Law
  *  @date May 2016
  */
 
 #include <stdio.h>
-#include <rt_misc.h>
+#include <string.h>
 #include "serial.h"
+#include "screen.h"
+
+#if defined(__CC_ARM) || defined(__ARMCC_VERSION)
+
+#include <rt_misc.h>
 
 struct __FILE { int handle; /* Add whatever you need here */ };
 FILE __stdout;
@@ -15,13 +27,33 @@ FILE __stdin;
 
 int fputc(int c, FILE *f)
 {
-	serial_putchar_blocking(c);
+	screen_putchar(c);
 	return c;
 }
 
+int fputs(const char *s, FILE *f)
+{
+	screen_write((const unsigned char *)s, strlen(s));
+	return 0;
+}
+
+int puts(const char *s)
+{
+	screen_write((const unsigned char *)s, strlen(s));
+	screen_putchar('\n');
+	return 0;
+}
+
+size_t fwrite(const void *p, size_t size, size_t nmemb, FILE *f)
+{
+	screen_write(p, size * nmemb);
+	return nmemb;
+}
+
 int fgetc(FILE *f)
 {
 	unsigned char c;
+	screen_flush();
 	serial_getchar_blocking(&c);
 	return c;
 }
@@ -41,3 +73,23 @@ void _sys_exit(int return_code)
 {
 label:  goto label;  /* endless loop */
 }
+
+#else	/* newlib */
+
+int _write(int fd, const char *ptr, int len)
+{
+	screen_write((const unsigned char *)ptr, len);
+	return len;
+}
+
+int _read(int fd, char *ptr, int len)
+{
+	if (len <= 0)
+		return 0;
+	
+	screen_flush();
+	serial_getchar_blocking((unsigned char *)ptr);
+	return 1;
+}
+
+#endif
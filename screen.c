@@ -0,0 +1,465 @@
+
+/** @file screen.c
+ *  @brief Differential terminal screen
+ *
+ *	Sits between stdout and the serial port and only sends the lines of a
+ *	screen which differ from what the terminal already shows. The menus clear
+ *	the screen by printing a run of blank lines and then redraw everything,
+ *	which at 115200 baud blocks for tens of milliseconds per key.
+ *
+ *	Output is collected one line at a time. A finished line is compared by
+ *	hash with the line on the same terminal row and only sent if it differs,
+ *	after moving the cursor there with CR LF or an ANSI cursor position,
+ *	whichever is shorter. SCREEN_ROWS blank lines in a row start a new frame
+ *	at the top row instead of being sent. Only a hash and a length per row is
+ *	kept, so a changed line is sent whole.
+ *
+ *	screen_flush() must be called before waiting for input. It sends the
+ *	unfinished line, such as a prompt, clears rows left over from a longer
+ *	previous frame and leaves the cursor where the next character goes.
+ *
+ *	A clear screen or cursor home sequence also starts a new frame. Other
+ *	escape sequences written to the layer are passed through and make the next
+ *	frame redraw every row.
+ *
+ *	What a call sends is gathered and handed to the serial port in one block
+ *	at the end of the call, so a changed line with its cursor movement and
+ *	erase costs one write to the tx ring buffer.
+ */
+
+#include <stdbool.h>
+#include "screen.h"
+#include "serial.h"
+
+/** Hash of a row whose content is not known */
+#define SCREEN_HASH_UNKNOWN		0ul
+
+/** FNV-1a parameters, the hash of an empty line is the offset basis */
+#define SCREEN_HASH_BASIS		2166136261ul
+#define SCREEN_HASH_PRIME		16777619ul
+
+/** Longest escape sequence held back to be recognised */
+#define SCREEN_ESCAPE_SIZE		8
+
+/** Bytes gathered before they are handed to the serial port */
+#define SCREEN_OUT_SIZE			64
+
+static void screen_send(unsigned char ch);
+static void screen_goto(uint32_t row, uint32_t col);
+static void screen_commit_line(void);
+
+/** Hash and length of the line shown on each terminal row */
+static uint32_t row_hash[SCREEN_ROWS];
+static uint8_t row_len[SCREEN_ROWS];
+
+/** Cursor position on the terminal, row SCREEN_ROWS if not known */
+static uint32_t term_row = SCREEN_ROWS;
+static uint32_t term_col;
+
+/** Row the line being collected goes to */
+static uint32_t cur_row;
+
+/** Line being collected */
+static unsigned char line[SCREEN_COLS];
+static uint32_t line_col;
+static uint32_t line_len;
+
+/** The line is already on the terminal, further characters are sent as is */
+static bool line_sent;
+
+/** Blank lines written but not placed yet */
+static uint32_t blank_run;
+
+/** Escape sequence being collected */
+static unsigned char escape[SCREEN_ESCAPE_SIZE];
+static uint32_t escape_len;
+
+/** Output since the last flush which has not been flushed */
+static bool dirty;
+
+/** Bytes to send gathered during the current call */
+static unsigned char out[SCREEN_OUT_SIZE];
+static uint32_t out_len;
+
+/** @name Byte counters */
+/** @{*/
+
+static uint32_t stats_written;
+static uint32_t stats_sent;
+static uint32_t stats_mark_written;
+static uint32_t stats_mark_sent;
+static uint32_t stats_last_written;
+static uint32_t stats_last_sent;
+
+/** @}*/
+
+/** @brief Hands the gathered bytes to the serial port.
+ */
+static void screen_push(void)
+{
+	if (out_len) {
+		serial_write_blocking(out, out_len);
+		out_len = 0;
+	}
+}
+
+/** @brief Sends a byte to the terminal.
+ *	@param ch The byte.
+ */
+static void screen_send(unsigned char ch)
+{
+	out[out_len++] = ch;
+	if (out_len == SCREEN_OUT_SIZE)
+		screen_push();
+	stats_sent++;
+}
+
+/** @brief Sends a decimal number of up to 3 digits.
+ *	@param val The number.
+ */
+static void screen_send_number(uint32_t val)
+{
+	if (val >= 100)
+		screen_send('0' + val / 100);
+	if (val >= 10)
+		screen_send('0' + (val / 10) % 10);
+	screen_send('0' + val % 10);
+}
+
+/** @brief Sends an ANSI control sequence without parameter.
+ *	@param final The final byte of the sequence.
+ */
+static void screen_send_control(unsigned char final)
+{
+	screen_send(0x1B);
+	screen_send('[');
+	screen_send(final);
+}
+
+/** @brief Moves the terminal cursor.
+ *	@param row Row from 0.
+ *	@param col Column from 0.
+ */
+static void screen_goto(uint32_t row, uint32_t col)
+{
+	if ((row == term_row) && (col == term_col))
+		return;
+
+	if ((col == 0) && (row == term_row)) {
+		screen_send('\r');
+	} else if ((col == 0) && (row == term_row + 1)) {
+		if (term_col != 0)
+			screen_send('\r');
+		screen_send('\n');
+	} else {
+		screen_send(0x1B);
+		screen_send('[');
+		screen_send_number(row + 1);
+		if (col != 0) {
+			screen_send(';');
+			screen_send_number(col + 1);
+		}
+		screen_send('H');
+	}
+
+	term_row = row;
+	term_col = col;
+}
+
+/** @brief Sends text at the terminal cursor.
+ *	@param text The text.
+ *	@param len Number of characters.
+ */
+static void screen_send_text(const unsigned char *text, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		screen_send(text[i]);
+
+	/* A full row leaves the cursor waiting to wrap */
+	term_col += len;
+	if (term_col >= SCREEN_COLS)
+		term_row = SCREEN_ROWS;
+}
+
+/** @brief Hashes the line being collected.
+ *	@returns FNV-1a hash of the line.
+ */
+static uint32_t screen_hash_line(void)
+{
+	uint32_t hash = SCREEN_HASH_BASIS;
+	uint32_t i;
+
+	for (i = 0; i < line_len; i++)
+		hash = (hash ^ line[i]) * SCREEN_HASH_PRIME;
+
+	return hash;
+}
+
+/** @brief Moves to the next row, scrolling the terminal at the bottom.
+ */
+static void screen_next_row(void)
+{
+	uint32_t i;
+
+	cur_row++;
+	if (cur_row < SCREEN_ROWS)
+		return;
+
+	/* A line feed on the bottom row scrolls every row up */
+	screen_goto(SCREEN_ROWS - 1, 0);
+	screen_send('\n');
+
+	for (i = 0; i < SCREEN_ROWS - 1; i++) {
+		row_hash[i] = row_hash[i + 1];
+		row_len[i] = row_len[i + 1];
+	}
+	row_hash[SCREEN_ROWS - 1] = SCREEN_HASH_BASIS;
+	row_len[SCREEN_ROWS - 1] = 0;
+
+	cur_row = SCREEN_ROWS - 1;
+}
+
+/** @brief Places a finished line on the current row.
+ *
+ *	The line is sent only if the row shows something else, followed by an
+ *	erase of the rest of the row if the old line was longer. A line sent by
+ *	screen_flush() waited for input, which the terminal may have echoed on
+ *	the row, so its content is taken as unknown.
+ */
+static void screen_commit_line(void)
+{
+	uint32_t hash;
+
+	if (line_sent) {
+		row_hash[cur_row] = SCREEN_HASH_UNKNOWN;
+		row_len[cur_row] = SCREEN_COLS;
+	} else {
+		hash = screen_hash_line();
+		if (hash != row_hash[cur_row]) {
+			screen_goto(cur_row, 0);
+			screen_send_text(line, line_len);
+			if (row_len[cur_row] > line_len)
+				screen_send_control('K');
+			row_hash[cur_row] = hash;
+			row_len[cur_row] = line_len;
+		}
+	}
+
+	line_col = 0;
+	line_len = 0;
+	line_sent = false;
+
+	screen_next_row();
+}
+
+/** @brief Places the blank lines written so far.
+ */
+static void screen_commit_blanks(void)
+{
+	while (blank_run) {
+		blank_run--;
+		screen_commit_line();
+	}
+}
+
+/** @brief Starts a new frame at the top row.
+ *
+ *	An unfinished line is dropped as the terminal would overwrite it.
+ */
+static void screen_new_frame(void)
+{
+	blank_run = 0;
+	line_col = 0;
+	line_len = 0;
+	line_sent = false;
+	cur_row = 0;
+}
+
+/** @brief Marks the content of every row as unknown.
+ *
+ *	Called after anything was sent to the terminal around the screen layer,
+ *	the next frame then redraws every row.
+ */
+void screen_invalidate(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < SCREEN_ROWS; i++) {
+		row_hash[i] = SCREEN_HASH_UNKNOWN;
+		row_len[i] = SCREEN_COLS;
+	}
+	term_row = SCREEN_ROWS;
+	line_sent = false;
+}
+
+/** @brief Collects an escape sequence.
+ *	@param ch Next character of the sequence.
+ *
+ *	Clear screen (ESC [ 2 J) and cursor home (ESC [ H) start a new frame and
+ *	are not sent. Any other sequence is sent unchanged once complete.
+ */
+static void screen_escape(unsigned char ch)
+{
+	uint32_t i;
+
+	escape[escape_len++] = ch;
+
+	/* Wait for the final byte of ESC [ <digits and ;> <letter> */
+	if (escape_len == 1)
+		return;
+	if ((escape_len == 2) && (ch == '['))
+		return;
+	if ((escape_len > 2) && (escape_len < SCREEN_ESCAPE_SIZE) &&
+		(((ch >= '0') && (ch <= '9')) || (ch == ';')))
+		return;
+
+	if (((escape_len == 4) && (escape[2] == '2') && (ch == 'J')) ||
+		((escape_len == 3) && (ch == 'H'))) {
+		screen_new_frame();
+	} else {
+		screen_commit_blanks();
+		for (i = 0; i < escape_len; i++)
+			screen_send(escape[i]);
+		screen_invalidate();
+	}
+
+	escape_len = 0;
+}
+
+/** @brief Initializes the screen layer.
+ *
+ *	What the terminal shows is not known at start up, so the first frame is
+ *	drawn in full.
+ */
+void screen_init(void)
+{
+	screen_new_frame();
+	screen_invalidate();
+}
+
+/** @brief Collects a character written to the screen.
+ *	@param ch The character.
+ */
+static void screen_put(unsigned char ch)
+{
+	stats_written++;
+	dirty = true;
+
+	if ((escape_len != 0) || (ch == 0x1B)) {
+		screen_escape(ch);
+		return;
+	}
+
+	switch (ch) {
+	case '\n':
+		if (line_len == 0 && !line_sent) {
+			/* A run of blank lines clears the screen */
+			blank_run++;
+			if (blank_run >= SCREEN_ROWS)
+				screen_new_frame();
+		} else {
+			screen_commit_blanks();
+			screen_commit_line();
+		}
+		break;
+	case '\r':
+		line_col = 0;
+		if (line_sent)
+			screen_goto(cur_row, 0);
+		break;
+	default:
+		screen_commit_blanks();
+		if (line_col == SCREEN_COLS) {
+			/* The terminal wraps long lines */
+			screen_commit_line();
+		}
+		line[line_col++] = ch;
+		if (line_col > line_len)
+			line_len = line_col;
+		if (line_sent)
+			screen_send_text(&ch, 1);
+		break;
+	}
+}
+
+/** @brief Writes a character to the screen.
+ *	@param ch The character.
+ */
+void screen_putchar(unsigned char ch)
+{
+	screen_put(ch);
+	screen_push();
+}
+
+/** @brief Writes a block of characters to the screen.
+ *	@param data The characters.
+ *	@param len Number of characters.
+ */
+void screen_write(const unsigned char *data, uint32_t len)
+{
+	while (len--)
+		screen_put(*data++);
+	screen_push();
+}
+
+/** @brief Brings the terminal up to date before waiting for input.
+ *
+ *	Sends the unfinished line, erases the rows below it which still show an
+ *	older frame and leaves the cursor after the unfinished line. The bytes
+ *	written and sent since the last flush are kept as the last interaction.
+ */
+void screen_flush(void)
+{
+	uint32_t row;
+
+	if (!dirty)
+		return;
+	dirty = false;
+
+	screen_commit_blanks();
+
+	/* Rows from the cursor down left over from a longer frame */
+	row = (line_len == 0 && !line_sent) ? cur_row : cur_row + 1;
+	for (; row < SCREEN_ROWS; row++) {
+		if (row_len[row] != 0)
+			break;
+	}
+	if (row < SCREEN_ROWS) {
+		screen_goto(row, 0);
+		screen_send_control('J');
+		for (; row < SCREEN_ROWS; row++) {
+			row_hash[row] = SCREEN_HASH_BASIS;
+			row_len[row] = 0;
+		}
+	}
+
+	if (line_len != 0 && !line_sent) {
+		/* A prompt, the rest of its line is sent as written */
+		screen_goto(cur_row, 0);
+		screen_send_text(line, line_len);
+		if (row_len[cur_row] > line_len)
+			screen_send_control('K');
+		line_sent = true;
+	}
+
+	screen_goto(cur_row, line_col);
+	screen_push();
+
+	stats_last_written = stats_written - stats_mark_written;
+	stats_last_sent = stats_sent - stats_mark_sent;
+	stats_mark_written = stats_written;
+	stats_mark_sent = stats_sent;
+}
+
+/** @brief Reads the byte counters.
+ *	@param stats Container for the counters.
+ */
+void screen_read_stats(struct screen_stats *stats)
+{
+	stats->written = stats_written;
+	stats->sent = stats_sent;
+	stats->last_written = stats_last_written;
+	stats->last_sent = stats_last_sent;
+}
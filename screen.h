@@ -0,0 +1,32 @@
+
+/** @file screen.h
+ *  @brief Differential terminal screen include file
+ */
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stdint.h>
+
+/** Terminal size assumed by the screen layer */
+#define SCREEN_ROWS			24
+#define SCREEN_COLS			80
+
+/** Byte counts of the screen layer */
+struct screen_stats {
+	uint32_t written;		/** Bytes written to the layer since reset */
+	uint32_t sent;			/** Bytes sent to the terminal since reset */
+	uint32_t last_written;	/** Bytes written for the last interaction */
+	uint32_t last_sent;		/** Bytes sent for the last interaction */
+};
+
+void screen_init(void);
+
+void screen_putchar(unsigned char ch);
+void screen_write(const unsigned char *data, uint32_t len);
+void screen_flush(void);
+void screen_invalidate(void);
+
+void screen_read_stats(struct screen_stats *stats);
+
+#endif	/* SCREEN_H */
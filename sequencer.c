@@ -0,0 +1,277 @@
+
+/** @file sequencer.c
+ *  @brief Waveform sequencer
+ *
+ *	Plays a list of waveform steps back to back on the DAC output. All sample
+ *	tables are allocated from the arena and built, and all timer values are
+ *	calculated, before the sequence starts. Step boundaries are timed by Timer 7 counting
+ *	milliseconds, and its update interrupt only has to point the DMA at the
+ *	next prepared table and write the new sample timer values.
+ *
+ *	Pin PA8 is toggled at every step boundary as a sync output.
+ */
+
+#include <stdio.h>
+#include "sequencer.h"
+#include "systick.h"
+
+/** Sync output pin on GPIOA */
+#define SEQUENCE_SYNC_PIN		8
+
+static void sequencer_halt(void);
+static void sequencer_release(void);
+static void sequencer_step_isr(void);
+
+/** @name Sequence definition */
+/** @{*/
+
+static struct sequence_step seq_steps[SEQUENCE_MAX_STEPS];
+static unsigned int seq_count = 0;
+static bool seq_loop = false;
+
+/** @}*/
+
+/** @name Sequence playback state */
+/** @{*/
+
+static struct waveform_slot seq_slots[SEQUENCE_MAX_STEPS] = {
+	{-1}, {-1}, {-1}, {-1}, {-1}, {-1}, {-1}, {-1}
+};
+static volatile unsigned int seq_current = 0;
+static volatile bool seq_running = false;
+static void (*seq_end_callback)(void) = NULL;
+
+/** Longest time spent switching steps in the interrupt, in core clocks */
+static volatile uint32_t seq_max_transition_cycles = 0;
+
+/** @}*/
+
+/** @brief Appends a step to the sequence.
+ *	@param step The step to append.
+ *	@returns 0 if successful and -1 if the step is invalid or the sequence is
+ *	full or running.
+ */
+int sequencer_add_step(const struct sequence_step *step)
+{
+	if (seq_running || (seq_count >= SEQUENCE_MAX_STEPS))
+		return -1;
+
+	if ((step->wave == PULSE) ||
+		(step->frequency > get_max_freq()) ||
+		(step->frequency < get_min_freq()) ||
+		(step->amplitude > get_max_amplitude()) ||
+		(step->amplitude < get_min_amplitude()) ||
+		(step->duration_ms > SEQUENCE_MAX_DURATION) ||
+		(step->duration_ms < SEQUENCE_MIN_DURATION))
+		return -1;
+
+	seq_steps[seq_count++] = *step;
+	return 0;
+}
+
+/** @brief Removes all steps from the sequence.
+ */
+void sequencer_clear(void)
+{
+	if (!seq_running)
+		seq_count = 0;
+}
+
+/** @brief Reads the steps of the sequence.
+ *	@param steps Handle to the array of steps.
+ *	@returns The number of steps.
+ */
+unsigned int sequencer_read_steps(const struct sequence_step **steps)
+{
+	*steps = seq_steps;
+	return seq_count;
+}
+
+/** @brief Sets whether the sequence restarts after its last step.
+ *	@param loop true to loop forever.
+ */
+void sequencer_set_loop(bool loop)
+{
+	seq_loop = loop;
+}
+
+/** @brief Reads whether the sequence restarts after its last step.
+ *	@returns true if looping.
+ */
+bool sequencer_get_loop(void)
+{
+	return seq_loop;
+}
+
+/** @brief Prepares all steps and starts playing the sequence.
+ *	@param offset DC offset in V applied to every step.
+ *	@param end_callback Function called from the interrupt when a sequence
+ *	which does not loop ends, or NULL.
+ *	@returns 0 if successful and -1 if the sequence is empty or does not fit.
+ *
+ *	The current output is stopped while the tables are built. The free space
+ *	of the arena is shared between the steps, each step gets an equal share
+ *	of what is left but may take all of it when its share is too small.
+ */
+int sequencer_start(float offset, void (*end_callback)(void))
+{
+	struct sequence_step *step;
+	struct arena_stats stats;
+	uint32_t words_left;
+	unsigned int i;
+
+	if (seq_running || (seq_count == 0))
+		return -1;
+
+	stop_waveform();
+	sequencer_release();
+
+	for (i = 0; i < seq_count; i++) {
+		step = &seq_steps[i];
+
+		arena_read_stats(&stats);
+		words_left = (stats.size - stats.used) / 4;
+
+		if (!prepare_waveform(step->wave, step->frequency, step->amplitude,
+					offset, words_left / (seq_count - i), &seq_slots[i]) &&
+			!prepare_waveform(step->wave, step->frequency, step->amplitude,
+					offset, words_left, &seq_slots[i])) {
+			sequencer_release();
+			return -1;
+		}
+	}
+
+	/* Tables are read by the DMA from here on */
+	for (i = 0; i < seq_count; i++)
+		arena_pin(seq_slots[i].handle, true);
+
+	/* Configure sync output */
+	RCC->AHBENR |= RCC_AHBENR_GPIOAEN;
+	GPIOA->MODER &= ~(3ul << 2* SEQUENCE_SYNC_PIN);
+	GPIOA->MODER |=  (1ul << 2* SEQUENCE_SYNC_PIN);
+	GPIOA->BSRR = (1ul << SEQUENCE_SYNC_PIN);
+
+	seq_end_callback = end_callback;
+	seq_max_transition_cycles = 0;
+	seq_current = 0;
+	seq_running = true;
+
+	/* Step timer counts milliseconds */
+	timer_disable(SEQUENCE_TIMER_IDX);
+	timer_init(SEQUENCE_TIMER_IDX, true, &sequencer_step_isr);
+	timer_write_prescaler(SEQUENCE_TIMER_IDX, (SystemCoreClock / 1000) - 1);
+	timer_write_counter(SEQUENCE_TIMER_IDX, seq_steps[0].duration_ms - 1);
+	timer_generate_update(SEQUENCE_TIMER_IDX);
+
+	/* Preload the duration of the step after the first */
+	if (seq_count > 1)
+		timer_write_counter(SEQUENCE_TIMER_IDX, seq_steps[1].duration_ms - 1);
+
+	play_waveform(&seq_slots[0]);
+
+	timer_enable_interrupt(SEQUENCE_TIMER_IDX);
+	timer_enable(SEQUENCE_TIMER_IDX);
+
+	return 0;
+}
+
+/** @brief Stops the step timer and the DAC output.
+ *
+ *	Safe to call from the step interrupt, the tables are left allocated.
+ */
+static void sequencer_halt(void)
+{
+	timer_disable(SEQUENCE_TIMER_IDX);
+	timer_disable_interrupt(SEQUENCE_TIMER_IDX);
+
+	if (seq_running)
+		stop_waveform();
+
+	seq_running = false;
+}
+
+/** @brief Releases the tables of all steps back to the arena.
+ */
+static void sequencer_release(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < SEQUENCE_MAX_STEPS; i++) {
+		if (seq_slots[i].handle >= 0)
+			release_waveform(&seq_slots[i]);
+	}
+}
+
+/** @brief Stops the sequence and the DAC output and releases its tables.
+ *
+ *	Also called after a sequence has ended by itself to give its tables back.
+ */
+void sequencer_stop(void)
+{
+	sequencer_halt();
+	sequencer_release();
+}
+
+/** @brief Checks if a sequence is playing.
+ *	@returns true if playing.
+ */
+bool sequencer_running(void)
+{
+	return seq_running;
+}
+
+/** @brief Reads the index of the step being played.
+ *	@returns The step index.
+ */
+unsigned int sequencer_read_current_step(void)
+{
+	return seq_current;
+}
+
+/** @brief Reads the longest step switch time since the sequence started.
+ *	@returns The time in microseconds.
+ */
+uint32_t sequencer_read_max_transition_us(void)
+{
+	return seq_max_transition_cycles / systick_cycles_per_us();
+}
+
+/** @brief Step boundary interrupt
+ *
+ *	Called on the Timer 7 update at the end of every step. The duration of the
+ *	step just started was preloaded at the previous boundary so only the DMA,
+ *	the sample timer and the duration of the following step are written here.
+ */
+static void sequencer_step_isr(void)
+{
+	uint32_t start;
+	uint32_t elapsed;
+	unsigned int next;
+
+	start = systick_get_cycles();
+
+	next = seq_current + 1;
+	if (next >= seq_count) {
+		if (!seq_loop) {
+			sequencer_halt();
+			if (seq_end_callback)
+				seq_end_callback();
+			return;
+		}
+		next = 0;
+	}
+
+	seq_current = next;
+	play_waveform(&seq_slots[next]);
+	GPIOA->ODR ^= (1ul << SEQUENCE_SYNC_PIN);
+
+	/* Preload the duration of the step after this one */
+	next++;
+	if (next >= seq_count)
+		next = 0;
+	timer_write_counter_fixed(SEQUENCE_TIMER_IDX, seq_steps[next].duration_ms - 1);
+
+	elapsed = systick_get_cycles() - start;
+	if (elapsed > seq_max_transition_cycles)
+		seq_max_transition_cycles = elapsed;
+}
@@ -0,0 +1,44 @@
+
+/** @file sequencer.h
+ *  @brief Waveform sequencer include file
+ */
+
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <stdbool.h>
+#include "wave_gen.h"
+
+/** Maximum number of steps in a sequence */
+#define SEQUENCE_MAX_STEPS		8
+
+/** Step duration limits in milliseconds */
+#define SEQUENCE_MIN_DURATION	1
+#define SEQUENCE_MAX_DURATION	65535
+
+/** Timer used to time the steps */
+#define SEQUENCE_TIMER_IDX		TIMER_IDX_7
+
+/** A single step of a sequence */
+struct sequence_step {
+	enum waveform wave;			/** DAC waveform, PULSE is not supported */
+	unsigned int frequency;		/** Frequency in Hz */
+	float amplitude;			/** Amplitude in V */
+	unsigned int duration_ms;	/** Time to play the step for */
+};
+
+int sequencer_add_step(const struct sequence_step *step);
+void sequencer_clear(void);
+unsigned int sequencer_read_steps(const struct sequence_step **steps);
+
+void sequencer_set_loop(bool loop);
+bool sequencer_get_loop(void);
+
+int sequencer_start(float offset, void (*end_callback)(void));
+void sequencer_stop(void);
+
+bool sequencer_running(void);
+unsigned int sequencer_read_current_step(void);
+uint32_t sequencer_read_max_transition_us(void);
+
+#endif	/* SEQUENCER_H */
@@ -13,14 +13,12 @@
  */
  
 #include <stdio.h>
+#include <string.h>
 #include "stm32f0xx.h"
 #include "serial.h"
-
-/** Baud rate settings */
-#define __DIV(__PCLK, __BAUD)       ((__PCLK*25)/(4*__BAUD))
-#define __DIVMANT(__PCLK, __BAUD)   (__DIV(__PCLK, __BAUD)/100)
-#define __DIVFRAQ(__PCLK, __BAUD)   (((__DIV(__PCLK, __BAUD) - (__DIVMANT(__PCLK, __BAUD) * 100)) * 16 + 50) / 100)
-#define __USART_BRR(__PCLK, __BAUD) ((__DIVMANT(__PCLK, __BAUD) << 4)|(__DIVFRAQ(__PCLK, __BAUD) & 0x0F))
+#include "baud.h"
+#include "trace.h"
+#include "event.h"
 
 /** The structure for a ring buffer */
 struct serial_ringbuf {
@@ -33,6 +31,7 @@ static int rx_rbuf_read(unsigned char *output);
 static int rx_rbuf_write(unsigned char input);
 static int tx_rbuf_read(unsigned char *output);
 static int tx_rbuf_write(unsigned char input);
+static int tx_rbuf_write_block(const unsigned char *input, int len);
 
 static void serial_handle_rx_interrupt(void);
 static void serial_handle_tx_interrupt(void);
@@ -47,6 +46,18 @@ static struct serial_ringbuf tx_rbuf;
 
 /** @}*/
 
+/** Callback invoked from the rx interrupt after a character is queued */
+static void (*serial_rx_callback)(void) = NULL;
+
+/** Callback run in place of sleeping while waiting for a character */
+static void (*serial_idle_callback)(void) = NULL;
+
+/** USART settings of the baud rate in use */
+static struct baud_setting serial_baud;
+
+/** Bytes sent since the tx interrupt was last disabled */
+static uint32_t tx_burst_bytes = 0;
+
 /** @name Ring buffer functions
  *	Functions for writing into and reading from the ring buffers.
  */
@@ -73,7 +84,7 @@ static int rx_rbuf_read(unsigned char *output)
  */
 static int rx_rbuf_write(unsigned char input)
 {
-	if ((rx_rbuf.tail + 1) % SERIAL_RBUF_SIZE == rx_rbuf.head)
+	if ((rx_rbuf.head + 1) % SERIAL_RBUF_SIZE == rx_rbuf.tail)
 		return -1;
 	
 	rx_rbuf.buffer[rx_rbuf.head] = input;
@@ -102,7 +113,7 @@ static int tx_rbuf_read(unsigned char *output)
  */
 static int tx_rbuf_write(unsigned char input)
 {
-	if ((tx_rbuf.tail + 1) % SERIAL_RBUF_SIZE == tx_rbuf.head)
+	if ((tx_rbuf.head + 1) % SERIAL_RBUF_SIZE == tx_rbuf.tail)
 		return -1;
 	
     tx_rbuf.buffer[tx_rbuf.head] = input;
@@ -110,15 +121,50 @@ static int tx_rbuf_write(unsigned char input)
 	return 0;
 }
 
+/** @brief Writes as many bytes as fit into the tx ring buffer.
+ *	@param input The bytes to be written.
+ *	@param len Number of bytes.
+ *	@returns Number of bytes written.
+ *
+ *	The bytes are copied in at most two pieces and head is moved once, so
+ *	the tx interrupt sees all of them at the same time.
+ */
+static int tx_rbuf_write_block(const unsigned char *input, int len)
+{
+	int head = tx_rbuf.head;
+	int space;
+	int first;
+	
+	space = (tx_rbuf.tail - head - 1 + SERIAL_RBUF_SIZE) % SERIAL_RBUF_SIZE;
+	if (len > space)
+		len = space;
+	
+	first = SERIAL_RBUF_SIZE - head;
+	if (first > len)
+		first = len;
+	
+	memcpy(&tx_rbuf.buffer[head], input, first);
+	memcpy(&tx_rbuf.buffer[0], input + first, len - first);
+	tx_rbuf.head = (head + len) % SERIAL_RBUF_SIZE;
+	
+	return len;
+}
+
 /** @}*/
 
 /**	@brief Initializes USART2
+ *	@param baud The baud rate.
+ *	@returns 0 if successful and -1 if the baud rate cannot be produced.
  *	
  *	This function initializes USART2 which is connected to the RX and TX of the
- *	ST-Link Debugger.
+ *	ST-Link Debugger. The baud rate is computed from SystemCoreClock, which is
+ *	also the USART clock as the APB prescaler is 1.
  */
-void serial_init(int baud)
+int serial_init(int baud)
 {
+	if (baud_compute(SystemCoreClock, baud, &serial_baud))
+		return -1;
+	
 	/* Enable clock */
 	RCC->AHBENR  |=  (   1ul << 17);	/* Enable GPIOA clock */
 	RCC->APB1ENR |=  (   1ul << 17);    /* Enable USART2 clock */
@@ -131,27 +177,134 @@ void serial_init(int baud)
 
 	NVIC_EnableIRQ(USART2_IRQn);
 
-	USART2->BRR  = __USART_BRR(48000000ul, baud); /* Clock at 48MHz */
+	USART2->BRR   = serial_baud.brr;
 	USART2->CR3   = 0x0000;             /* no flow control */
 	USART2->CR2   = 0x0000;             /* 1 stop bit */
 	USART2->CR1   = ((   1ul <<  2) |	/* enable RX */
 				     (   1ul <<  3) |	/* enable TX */
 				     (   0ul << 12) |  	/* 1 start bit, 8 data bits */
 				     (   1ul <<  0) |   /* enable USART */
+					(serial_baud.over8 ? USART_CR1_OVER8 : 0) |
 					USART_CR1_RXNEIE );	/* Enable receive interrupt */
+	
+	return 0;
+}
+
+/** @brief Changes the baud rate of USART2.
+ *	@param baud The new baud rate.
+ *	@returns 0 if successful and -1 if the baud rate cannot be produced, in
+ *	which case the baud rate is left unchanged.
+ *
+ *	Waits until everything queued has been sent, as BRR and OVER8 can only be
+ *	written with the USART disabled. Characters arriving during the switch
+ *	are lost.
+ */
+int serial_set_baud(int baud)
+{
+	struct baud_setting setting;
+	
+	if (baud_compute(SystemCoreClock, baud, &setting))
+		return -1;
+	
+	while (tx_rbuf.head != tx_rbuf.tail)
+		event_sleep();
+	while (!(USART2->ISR & USART_ISR_TC))
+		;
+	
+	USART2->CR1 &= ~(USART_CR1_UE);
+	USART2->BRR = setting.brr;
+	if (setting.over8)
+		USART2->CR1 |= USART_CR1_OVER8;
+	else
+		USART2->CR1 &= ~(USART_CR1_OVER8);
+	USART2->CR1 |= USART_CR1_UE;
+	
+	serial_baud = setting;
+	return 0;
+}
+
+/** @brief Reads the baud rate in use.
+ *	@param setting Container for the USART settings of the baud rate.
+ */
+void serial_read_baud(struct baud_setting *setting)
+{
+	*setting = serial_baud;
+}
+
+/** @brief Sets the function to call whenever a character is received.
+ *	@param callback The function to call, or NULL for none.
+ *
+ *	The callback is called from the USART2 interrupt.
+ */
+void serial_set_rx_callback(void (*callback)(void))
+{
+	serial_rx_callback = callback;
+}
+
+/** @brief Sets the function to run while waiting for a character.
+ *	@param callback The function to run, or NULL to sleep instead.
+ *
+ *	serial_getchar_blocking() runs the callback over and over until a
+ *	character arrives, so it should do a bounded piece of work and sleep
+ *	with event_sleep() when it has none.
+ */
+void serial_set_idle_callback(void (*callback)(void))
+{
+	serial_idle_callback = callback;
+}
+
+/** @brief Checks if there are received characters waiting to be read.
+ *	@returns 1 if rx_rbuf is not empty and 0 if otherwise.
+ */
+int serial_rx_pending(void)
+{
+	return (rx_rbuf.head != rx_rbuf.tail);
 }
 
 /** @brief Writes a character into tx_rbuf
  *	@param ch The character to be written.
  *
- *	This waits until tx_rbuf has a slot available before writing into it.
+ *	This waits until tx_rbuf has a slot available before writing into it. The
+ *	core sleeps while waiting for the tx interrupt to free a slot.
  */
 void serial_putchar_blocking(unsigned char ch)
 {
-	while (tx_rbuf_write(ch));
+	while (tx_rbuf_write(ch))
+		event_sleep();
 	USART2->CR1 |= USART_CR1_TXEIE;
 }
 
+/** @brief Writes a block of characters into tx_rbuf
+ *	@param data The characters to be written.
+ *	@param len Number of characters.
+ *
+ *	Copies as much as fits and enables the tx interrupt in one critical
+ *	section, once per copy instead of once per character. The core sleeps
+ *	while waiting for the tx interrupt to free space for the rest.
+ */
+void serial_write_blocking(const unsigned char *data, int len)
+{
+	uint32_t primask;
+	int written;
+	
+	while (len > 0) {
+		primask = __get_PRIMASK();
+		__disable_irq();
+		written = tx_rbuf_write_block(data, len);
+		if (written)
+			USART2->CR1 |= USART_CR1_TXEIE;
+		__set_PRIMASK(primask);
+		
+		if (written == 0) {
+			event_sleep();
+			continue;
+		}
+		
+		data += written;
+		len -= written;
+	}
+}
+
 /** @brief Writes a character into tx_rbuf
  *	@param ch The character to be written.
  *	@returns 0 if successful and -1 if the tx buffer is full.
@@ -173,11 +326,17 @@ int serial_putchar_nonblocking(unsigned char ch)
  *	@returns 0 if a new character is read and -1 if otherwise.
  *
  *	This function attemps to read form the rx ring buffer in blocking manner.
- *	It will wait until a new character is received before returning.
+ *	It will wait until a new character is received before returning. The core
+ *	sleeps while waiting, or runs the idle callback if one is set.
  */
 void serial_getchar_blocking(unsigned char *ch)
 {
-	while (rx_rbuf_read(ch));
+	while (rx_rbuf_read(ch)) {
+		if (serial_idle_callback)
+			serial_idle_callback();
+		else
+			event_sleep();
+	}
 }
 
 /** @brief Reads a char from the rx_ringbuf
@@ -198,6 +357,9 @@ int serial_getchar_nonblocking(unsigned char *ch)
 static void serial_handle_rx_interrupt(void)
 {
 	rx_rbuf_write((unsigned char)(USART2->RDR & 0xFF));
+	
+	if (serial_rx_callback)
+		serial_rx_callback();
 }
 
 /** @brief Function for handling tx interrupts
@@ -208,8 +370,14 @@ static void serial_handle_tx_interrupt(void)
 	
 	if (!tx_rbuf_read(&output)) {
 		USART2->TDR = (output & 0xFF);
+		tx_burst_bytes++;
 	} else {
 		USART2->CR1 &= ~(USART_CR1_TXEIE);
+		
+		/* One record per burst, a record per byte would flood the trace */
+		trace_event(TRACE_USART2_IRQ, ((tx_burst_bytes > 0xFF ? 0xFF :
+			tx_burst_bytes) << 16) | (USART2->ISR & 0xFFFF));
+		tx_burst_bytes = 0;
 	}
 }
 
@@ -217,6 +385,10 @@ static void serial_handle_tx_interrupt(void)
  */
 void USART2_IRQHandler(void)
 {
+	if (USART2->ISR & (USART_ISR_RXNE | USART_ISR_ORE | USART_ISR_NE |
+		USART_ISR_FE | USART_ISR_PE))
+		trace_event(TRACE_USART2_IRQ, USART2->ISR & 0xFFFF);
+	
 	if (USART2->ISR & USART_ISR_RXNE)
 		serial_handle_rx_interrupt();
 	
@@ -8,12 +8,20 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
+#include "baud.h"
+
 /** Ring buffer size */
 #define SERIAL_RBUF_SIZE		200
 
-void serial_init(int baud);
+int serial_init(int baud);
+int serial_set_baud(int baud);
+void serial_read_baud(struct baud_setting *setting);
+void serial_set_rx_callback(void (*callback)(void));
+void serial_set_idle_callback(void (*callback)(void));
+int serial_rx_pending(void);
 
 void serial_putchar_blocking(unsigned char ch);
+void serial_write_blocking(const unsigned char *data, int len);
 int serial_putchar_nonblocking(unsigned char ch);
 void serial_getchar_blocking(unsigned char *ch);
 int serial_getchar_nonblocking(unsigned char *ch);
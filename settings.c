@@ -0,0 +1,129 @@
+
+/** @file settings.c
+ *  @brief Output settings mailbox
+ *
+ *	Carries complete settings snapshots from the input handlers (producer) to
+ *	the output engine in the main loop (consumer). The mailbox holds only the
+ *	newest snapshot: posting again before the consumer took the last one
+ *	replaces it, so a burst of changes is applied once.
+ *
+ *	The snapshot is guarded by a sequence number instead of a lock. The
+ *	producer makes it odd while it writes and even again when done, so it
+ *	never waits. The consumer copies the snapshot and retries if the sequence
+ *	number was odd or moved meanwhile, so it never applies a half written
+ *	one. This holds with the producer in an interrupt handler. There must be
+ *	only one producer context and one consumer context.
+ */
+
+#include <string.h>
+#include "settings.h"
+#include "event.h"
+#include "trace.h"
+
+/** Newest posted snapshot */
+static struct waveform_settings mailbox;
+
+/** Sequence number of mailbox, odd while being written, written by the producer only */
+static volatile uint32_t post_seq;
+
+/** Sequence number of the last snapshot taken, written by the consumer only */
+static uint32_t take_seq;
+
+/** @name Statistics
+ *	Each counter is written by one side only.
+ */
+/** @{*/
+
+static uint32_t stats_posted;
+static uint32_t stats_taken;
+static uint32_t stats_coalesced;
+static uint32_t stats_discarded;
+
+/** @}*/
+
+/** @brief Posts a settings snapshot to the output engine.
+ *	@param settings The snapshot, copied into the mailbox.
+ *
+ *	Replaces a snapshot not taken yet and wakes the main loop with
+ *	EVENT_SETTINGS.
+ */
+void settings_post(const struct waveform_settings *settings)
+{
+	post_seq++;
+	__DMB();
+	memcpy(&mailbox, settings, sizeof(mailbox));
+	__DMB();
+	post_seq++;
+
+	stats_posted++;
+	trace_event(TRACE_SETTINGS, (post_seq >> 1) & TRACE_ARG_MASK);
+	event_post(EVENT_SETTINGS);
+}
+
+/** @brief Takes the newest settings snapshot.
+ *	@param settings Container for the snapshot.
+ *	@returns true if a snapshot newer than the last one taken was copied.
+ */
+bool settings_take(struct waveform_settings *settings)
+{
+	uint32_t seq;
+
+	while (1) {
+		seq = post_seq;
+		if (seq == take_seq)
+			return false;
+		if (seq & 1)
+			continue;
+
+		__DMB();
+		memcpy(settings, &mailbox, sizeof(mailbox));
+		__DMB();
+
+		if (seq == post_seq)
+			break;
+	}
+
+	/* Sequence numbers step by 2 per snapshot */
+	stats_coalesced += ((seq - take_seq) >> 1) - 1;
+	stats_taken++;
+	take_seq = seq;
+
+	return true;
+}
+
+/** @brief Drops the snapshots posted since the last one taken.
+ *
+ *	They count as discarded, not as taken or coalesced.
+ */
+void settings_discard(void)
+{
+	uint32_t seq;
+
+	do {
+		seq = post_seq;
+	} while (seq & 1);
+
+	stats_discarded += (seq - take_seq) >> 1;
+	take_seq = seq;
+}
+
+/** @brief Tells if a snapshot newer than the last one taken was posted.
+ *	@returns true if settings_take() would return a snapshot.
+ *
+ *	This is cheap enough to be polled while a table is being built.
+ */
+bool settings_pending(void)
+{
+	return post_seq != take_seq;
+}
+
+/** @brief Reads the mailbox statistics.
+ *	@param stats Container for the statistics.
+ */
+void settings_read_stats(struct settings_stats *stats)
+{
+	stats->posted = stats_posted;
+	stats->taken = stats_taken;
+	stats->coalesced = stats_coalesced;
+	stats->discarded = stats_discarded;
+}
@@ -0,0 +1,38 @@
+
+/** @file settings.h
+ *  @brief Output settings mailbox include file
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdbool.h>
+#include "wave_gen.h"
+
+/** Complete set of output settings */
+struct waveform_settings {
+	enum waveform wave;
+	unsigned int frequency;
+	float amplitude;
+	float offset;
+	struct harmonic harmonics[MAX_HARMONICS];
+	unsigned int harmonic_count;
+	unsigned int duty;
+};
+
+/** Mailbox statistics */
+struct settings_stats {
+	uint32_t posted;		/** Snapshots posted */
+	uint32_t taken;			/** Snapshots taken by the output engine */
+	uint32_t coalesced;		/** Snapshots replaced by a newer one before being taken */
+	uint32_t discarded;		/** Snapshots dropped by settings_discard() */
+};
+
+void settings_post(const struct waveform_settings *settings);
+bool settings_take(struct waveform_settings *settings);
+void settings_discard(void);
+bool settings_pending(void);
+
+void settings_read_stats(struct settings_stats *stats);
+
+#endif	/* SETTINGS_H */
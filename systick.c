@@ -0,0 +1,82 @@
+
+/** @file systick.c
+ *  @brief SysTick time base
+ *
+ *	SysTick is run from the core clock and interrupts every millisecond. The
+ *	millisecond count together with the current SysTick value gives a cycle
+ *	counter which is used to time events shorter than a millisecond. The cycle
+ *	counter wraps around every 2^32 core clocks and is only meant for measuring
+ *	short intervals.
+ */
+
+#include "systick.h"
+
+/** Number of milliseconds elapsed since systick_init() */
+static volatile uint32_t systick_ms;
+
+/** Number of core clocks between SysTick interrupts */
+static uint32_t systick_cycles_per_tick;
+
+/** @brief Starts SysTick as the system time base.
+ *
+ *	@note SystemCoreClock must be up to date before calling this.
+ */
+void systick_init(void)
+{
+	systick_ms = 0;
+	systick_cycles_per_tick = SystemCoreClock / SYSTICK_RATE_HZ;
+	
+	SysTick_Config(systick_cycles_per_tick);
+}
+
+/** @brief Reads the number of milliseconds since systick_init().
+ *	@returns The millisecond count.
+ */
+uint32_t systick_get_ms(void)
+{
+	return systick_ms;
+}
+
+/** @brief Reads the core clock cycle counter.
+ *	@returns The number of core clocks since systick_init() modulo 2^32.
+ *
+ *	This may be called with interrupts disabled. A SysTick wrap which has not
+ *	been serviced yet is accounted for by checking the pending bit.
+ */
+uint32_t systick_get_cycles(void)
+{
+	uint32_t primask;
+	uint32_t ms;
+	uint32_t val;
+	
+	primask = __get_PRIMASK();
+	__disable_irq();
+	
+	ms = systick_ms;
+	val = SysTick->VAL;
+	
+	if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+		/* Wrapped but not serviced, reread in case it wrapped after VAL */
+		val = SysTick->VAL;
+		ms++;
+	}
+	
+	__set_PRIMASK(primask);
+	
+	return (ms * systick_cycles_per_tick) + (SysTick->LOAD - val);
+}
+
+/** @brief Reads the number of core clocks per microsecond.
+ *	@returns Core clocks per microsecond.
+ */
+uint32_t systick_cycles_per_us(void)
+{
+	return (systick_cycles_per_tick * SYSTICK_RATE_HZ) / 1000000;
+}
+
+/** @brief IRQ Handler for SysTick
+ */
+void SysTick_Handler(void)
+{
+	systick_ms++;
+}
@@ -0,0 +1,20 @@
+
+/** @file systick.h
+ *  @brief SysTick time base include file
+ */
+
+#ifndef SYSTICK_H
+#define SYSTICK_H
+
+#include "stm32f0xx.h"
+
+/** SysTick interrupt rate */
+#define SYSTICK_RATE_HZ		1000
+
+void systick_init(void);
+
+uint32_t systick_get_ms(void);
+uint32_t systick_get_cycles(void);
+uint32_t systick_cycles_per_us(void);
+
+#endif	/* SYSTICK_H */
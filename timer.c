@@ -12,6 +12,8 @@
 
 #include <stdio.h>
 #include "timer.h"
+#include "dac.h"
+#include "trace.h"
 
 static void timer_extract_base_pointer(enum timer_index idx,
 								TIM_TypeDef **tim);
@@ -100,14 +102,10 @@ int timer_init(enum timer_index idx, bool interrupt, void (*callback)(void))
  */
 int timer_write_counter(enum timer_index idx, uint16_t val)
 {
-	TIM_TypeDef *tim;
-	
 	if ((idx != TIMER_IDX_6) & (idx != TIMER_IDX_7))
 		return -1;
 	
-	timer_extract_base_pointer(idx, &tim);
-
-	tim->ARR = val;
+	timer_write_counter_fixed(idx, val);
 	return 0;
 }
 
@@ -120,14 +118,26 @@ int timer_write_counter(enum timer_index idx, uint16_t val)
  */
 int timer_write_prescaler(enum timer_index idx, uint16_t val)
 {
-	TIM_TypeDef *tim;
-	
 	if ((idx != TIMER_IDX_6) & (idx != TIMER_IDX_7))
 		return -1;
 	
-	timer_extract_base_pointer(idx, &tim);
+	timer_write_prescaler_fixed(idx, val);
+	return 0;
+}
 
-	tim->PSC = val;
+/** @brief Generates an update event
+ *	@param idx The timer to configure.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	This reloads the counter and transfers the preloaded prescaler and counter
+ *	values into the active registers immediately.
+ */
+int timer_generate_update(enum timer_index idx)
+{
+	if ((idx != TIMER_IDX_6) & (idx != TIMER_IDX_7))
+		return -1;
+	
+	timer_generate_update_fixed(idx);
 	return 0;
 }
 
@@ -178,14 +188,10 @@ int timer_disable_interrupt(enum timer_index idx)
  */
 int timer_disable(enum timer_index idx)
 {
-	TIM_TypeDef *tim;
-	
 	if ((idx != TIMER_IDX_6) & (idx != TIMER_IDX_7))
 		return -1;
 	
-	timer_extract_base_pointer(idx, &tim);
-
-	tim->CR1 &= ~(TIM_CR1_CEN);
+	timer_disable_fixed(idx);
 	return 0;
 }
 
@@ -195,28 +201,32 @@ int timer_disable(enum timer_index idx)
  */
 int timer_enable(enum timer_index idx)
 {
-	TIM_TypeDef *tim;
-	
 	if ((idx != TIMER_IDX_6) & (idx != TIMER_IDX_7))
 		return -1;
 	
-	timer_extract_base_pointer(idx, &tim);
-
-	tim->CR1 |= TIM_CR1_CEN;
+	timer_enable_fixed(idx);
 	return 0;
 }
 
 /** @name Timer Interrupt Service Routine. */
 /** @{*/
 
-/** @brief IRQ Handler for Timer 6
+/** @brief IRQ Handler for Timer 6 and the DAC
+ *
+ *	UIF is set on every update even with the interrupt disabled, so the timer
+ *	is only serviced when its interrupt is enabled.
  */
 void TIM6_DAC_IRQHandler(void)
 {
-	TIM6->SR &= ~(TIM_SR_UIF);
+	if ((TIM6->DIER & TIM_DIER_UIE) && (TIM6->SR & TIM_SR_UIF)) {
+		TIM6->SR &= ~(TIM_SR_UIF);
+		trace_event(TRACE_TIMER_IRQ, 6);
+
+		if (timer6_callback)
+			timer6_callback();
+	}
 
-	if (timer6_callback)
-		timer6_callback();
+	dac_handle_interrupt();
 }
 
 /** @brief IRQ Handler for Timer 7
@@ -224,6 +234,7 @@ void TIM6_DAC_IRQHandler(void)
 void TIM7_IRQHandler(void)
 {
 	TIM7->SR &= ~(TIM_SR_UIF);
+	trace_event(TRACE_TIMER_IRQ, 7);
 
 	if (timer7_callback)
 		timer7_callback();
@@ -21,6 +21,7 @@ int timer_init(enum timer_index idx, bool interrupt,
 
 int timer_write_counter(enum timer_index idx, uint16_t val);
 int timer_write_prescaler(enum timer_index idx, uint16_t val);
+int timer_generate_update(enum timer_index idx);
 
 int timer_disable_interrupt(enum timer_index idx);
 int timer_enable_interrupt(enum timer_index idx);
@@ -28,4 +29,43 @@ int timer_enable_interrupt(enum timer_index idx);
 int timer_disable(enum timer_index idx);
 int timer_enable(enum timer_index idx);
 
+/** @name Fixed timer variants
+ *	For a timer fixed at compile time. The timer is not checked and its base
+ *	pointer folds to a constant, so each compiles to the register access
+ *	alone. timer_init() must have been called once for the timer.
+ */
+/** @{*/
+
+static inline TIM_TypeDef *timer_base_fixed(enum timer_index idx)
+{
+	return (idx == TIMER_IDX_6) ? TIM6 : TIM7;
+}
+
+static inline void timer_write_counter_fixed(enum timer_index idx, uint16_t val)
+{
+	timer_base_fixed(idx)->ARR = val;
+}
+
+static inline void timer_write_prescaler_fixed(enum timer_index idx, uint16_t val)
+{
+	timer_base_fixed(idx)->PSC = val;
+}
+
+static inline void timer_generate_update_fixed(enum timer_index idx)
+{
+	timer_base_fixed(idx)->EGR = TIM_EGR_UG;
+}
+
+static inline void timer_disable_fixed(enum timer_index idx)
+{
+	timer_base_fixed(idx)->CR1 &= ~(TIM_CR1_CEN);
+}
+
+static inline void timer_enable_fixed(enum timer_index idx)
+{
+	timer_base_fixed(idx)->CR1 |= TIM_CR1_CEN;
+}
+
+/** @}*/
+
 #endif	/* TIMER_H */
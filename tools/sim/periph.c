@@ -0,0 +1,540 @@
+
+/** @file periph.c
+ *  @brief Host peripheral models
+ *
+ *	Defines the register instances of the mock device header and models the
+ *	peripherals on the DAC output path closely enough to reproduce the output
+ *	of the firmware sample for sample:
+ *
+ *	- Timer 6 and 7 count with preloaded PSC and ARR, which only take effect
+ *	  at an update event as on the device. An update of Timer 6 with its
+ *	  master mode set to update triggers DAC channel 1.
+ *	- A DAC channel 1 trigger moves the data holding register to DOR1 and
+ *	  raises a DMA request on DMA channel 3.
+ *	- DMA channel 3 copies one item from CMAR to CPAR per request, counting
+ *	  CNDTR down and reloading it in circular mode.
+ *	- SysTick interrupts every LOAD+1 core clocks.
+ *	- Timer 2 counts up freely over 32 bits while enabled, its update events
+ *	  and interrupts are not modelled.
+ *
+ *	Time only passes in periph_run_until(). Firmware functions called between
+ *	runs take no simulated time, and periph_sync() picks up their register
+ *	writes. The update DMA request of Timer 6 (UDE) is not modelled, the DAC
+ *	request alone paces the DMA.
+ *
+ *	The firmware stores addresses in 32 bit registers, so the simulator must
+ *	be linked as a non position independent executable to keep the static
+ *	sample tables below 4 GB.
+ *
+ *	Register accesses of the firmware can be counted between
+ *	periph_count_start() and periph_count_stop(). The registers share one
+ *	page, which is protected while counting so that every access faults. The
+ *	fault handler counts the access and opens the page for one single
+ *	stepped instruction. This needs Linux on x86-64.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include "periph.h"
+
+/** Interrupt handlers of the firmware */
+void SysTick_Handler(void);
+void TIM6_DAC_IRQHandler(void);
+void TIM7_IRQHandler(void);
+void DMA1_Channel2_3_IRQHandler(void);
+
+/** The state of a simulated basic timer */
+struct sim_timer {
+	TIM_TypeDef *tim;
+	void (*irq)(void);
+	bool running;
+	uint32_t psc;			/** Active prescaler */
+	uint32_t arr;			/** Active auto reload */
+	uint32_t cnt_base;		/** Counter value at base_time */
+	uint64_t base_time;
+	uint64_t next_update;
+};
+
+/** The state of the simulated DMA channel */
+struct sim_dma {
+	DMA_Channel_TypeDef *ch;
+	uint32_t cmar;			/** CMAR when CNDTR was last written */
+	uint32_t reload;		/** CNDTR value reloaded in circular mode */
+	uint32_t cndtr;			/** Count left, mirrored into CNDTR */
+};
+
+static void timer_schedule(struct sim_timer *st);
+static void timer_update(struct sim_timer *st, uint64_t t);
+static void timer_sync(struct sim_timer *st, uint64_t t);
+static void dma_sync(struct sim_dma *sd);
+static void dma_request(struct sim_dma *sd);
+static void dac_trigger(uint64_t t);
+static void tim2_sync(uint64_t t);
+
+/** @name Register instances */
+/** @{*/
+
+/** All registers in a page of their own, so they can be protected alone */
+static struct __attribute__((aligned(PERIPH_PAGE_SIZE))) {
+	RCC_TypeDef rcc;
+	GPIO_TypeDef gpioa, gpiob, gpioc;
+	DAC_TypeDef dac;
+	DMA_TypeDef dma1;
+	DMA_Channel_TypeDef dma1_channel3, dma1_channel4;
+	TIM_TypeDef tim2, tim3, tim6, tim7;
+	USART_TypeDef usart2;
+	FLASH_TypeDef flash;
+	SysTick_Type systick;
+	SCB_Type scb;
+} regs;
+
+RCC_TypeDef *RCC = &regs.rcc;
+GPIO_TypeDef *GPIOA = &regs.gpioa, *GPIOB = &regs.gpiob, *GPIOC = &regs.gpioc;
+DAC_TypeDef *DAC = &regs.dac;
+DMA_TypeDef *DMA1 = &regs.dma1;
+DMA_Channel_TypeDef *DMA1_Channel3 = &regs.dma1_channel3;
+DMA_Channel_TypeDef *DMA1_Channel4 = &regs.dma1_channel4;
+TIM_TypeDef *TIM2 = &regs.tim2, *TIM3 = &regs.tim3;
+TIM_TypeDef *TIM6 = &regs.tim6, *TIM7 = &regs.tim7;
+USART_TypeDef *USART2 = &regs.usart2;
+FLASH_TypeDef *FLASH = &regs.flash;
+SysTick_Type *SysTick = &regs.systick;
+SCB_Type *SCB = &regs.scb;
+
+uint32_t SystemCoreClock = PERIPH_CLOCK_HZ;
+
+/** @}*/
+
+/** @name Model state */
+/** @{*/
+
+static uint64_t sim_now;
+static uint64_t sim_next_systick;
+static struct sim_timer sim_tim6 = {&regs.tim6, &TIM6_DAC_IRQHandler};
+static struct sim_timer sim_tim7 = {&regs.tim7, &TIM7_IRQHandler};
+static struct sim_dma sim_dma3 = {&regs.dma1_channel3};
+static uint32_t sim_dac_dhr;
+static void (*sim_dac_hook)(uint64_t cycles, uint32_t code);
+static bool sim_tim2_running;
+static uint64_t sim_tim2_base;		/** Time the counter was last 0 */
+static struct periph_count sim_count;
+static volatile sig_atomic_t sim_counting;
+
+
+/** @}*/
+
+/** @name CMSIS functions */
+/** @{*/
+
+void SystemCoreClockUpdate(void) {}
+void NVIC_EnableIRQ(IRQn_Type irq) {}
+void NVIC_DisableIRQ(IRQn_Type irq) {}
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) {}
+void __WFI(void) {}
+void __NOP(void) {}
+void __DSB(void) {}
+void __ISB(void) {}
+void __disable_irq(void) {}
+void __enable_irq(void) {}
+uint32_t __get_PRIMASK(void) { return 0; }
+void __set_PRIMASK(uint32_t primask) {}
+
+uint32_t SysTick_Config(uint32_t ticks)
+{
+	SysTick->LOAD = ticks - 1;
+	SysTick->VAL = 0;
+	sim_next_systick = sim_now + ticks;
+	return 0;
+}
+
+/** @}*/
+
+/** @brief Schedules the next update of a running timer.
+ *	@param st The timer.
+ */
+static void timer_schedule(struct sim_timer *st)
+{
+	uint64_t ticks;
+
+	/* A counter above ARR runs up to 0xFFFF and wraps first */
+	if (st->cnt_base <= st->arr)
+		ticks = st->arr - st->cnt_base + 1;
+	else
+		ticks = 0x10000 - st->cnt_base + st->arr + 1;
+
+	st->next_update = st->base_time + ticks * (st->psc + 1);
+}
+
+/** @brief Processes an update event of a timer.
+ *	@param st The timer.
+ *	@param t Time of the update in core clocks.
+ */
+static void timer_update(struct sim_timer *st, uint64_t t)
+{
+	TIM_TypeDef *tim = st->tim;
+
+	st->psc = tim->PSC & 0xFFFF;
+	st->arr = tim->ARR & 0xFFFF;
+	st->cnt_base = 0;
+	st->base_time = t;
+	tim->CNT = 0;
+	tim->SR |= TIM_SR_UIF;
+
+	if (st->running)
+		timer_schedule(st);
+
+	if ((tim == TIM6) && ((tim->CR2 & TIM_CR2_MMS) == TIM_CR2_MMS_1))
+		dac_trigger(t);
+
+	if (tim->DIER & TIM_DIER_UIE)
+		st->irq();
+}
+
+/** @brief Picks up firmware writes to a timer.
+ *	@param st The timer.
+ *	@param t Current time in core clocks.
+ */
+static void timer_sync(struct sim_timer *st, uint64_t t)
+{
+	TIM_TypeDef *tim = st->tim;
+	bool enabled = tim->CR1 & TIM_CR1_CEN;
+	uint32_t cnt;
+
+	cnt = tim->CNT & 0xFFFF;
+	if (st->running)
+		cnt = (st->cnt_base + (t - st->base_time) / (st->psc + 1)) & 0xFFFF;
+
+	if (enabled != st->running) {
+		st->running = enabled;
+		st->cnt_base = cnt;
+		st->base_time = t;
+		if (enabled)
+			timer_schedule(st);
+	}
+
+	tim->CNT = cnt;
+
+	/* Without preload ARR takes effect at once */
+	if (!(tim->CR1 & TIM_CR1_ARPE) && ((tim->ARR & 0xFFFF) != st->arr)) {
+		st->arr = tim->ARR & 0xFFFF;
+		st->cnt_base = cnt;
+		st->base_time = t;
+		if (st->running)
+			timer_schedule(st);
+	}
+
+	if (tim->EGR & TIM_EGR_UG) {
+		tim->EGR = 0;
+		timer_update(st, t);
+	}
+}
+
+/** @brief Picks up firmware writes to the DMA channel.
+ *	@param sd The channel.
+ *
+ *	A new CMAR or CNDTR value reprograms the transfer.
+ */
+static void dma_sync(struct sim_dma *sd)
+{
+	if ((sd->ch->CNDTR != sd->cndtr) || (sd->ch->CMAR != sd->cmar)) {
+		sd->cmar = sd->ch->CMAR;
+		sd->cndtr = sd->ch->CNDTR & 0xFFFF;
+		sd->reload = sd->cndtr;
+	}
+}
+
+/** @brief Serves a DMA request.
+ *	@param sd The channel.
+ */
+static void dma_request(struct sim_dma *sd)
+{
+	DMA_Channel_TypeDef *ch = sd->ch;
+	uintptr_t addr;
+	uint32_t msize;
+	uint32_t val;
+
+	dma_sync(sd);
+
+	if (!(ch->CCR & DMA_CCR_EN) || (sd->cndtr == 0))
+		return;
+
+	msize = 1u << ((ch->CCR & DMA_CCR_MSIZE) >> 10);
+	addr = sd->cmar;
+	if (ch->CCR & DMA_CCR_MINC)
+		addr += (sd->reload - sd->cndtr) * msize;
+
+	if (msize == 1)
+		val = *(const uint8_t *)addr;
+	else if (msize == 2)
+		val = *(const uint16_t *)addr;
+	else
+		val = *(const uint32_t *)addr;
+
+	if (ch->CPAR == (uint32_t)(uintptr_t)&DAC->DHR12R1) {
+		DAC->DHR12R1 = val & 0xFFF;
+		sim_dac_dhr = val & 0xFFF;
+	} else if (ch->CPAR == (uint32_t)(uintptr_t)&DAC->DHR8R1) {
+		DAC->DHR8R1 = val & 0xFF;
+		sim_dac_dhr = (val & 0xFF) << 4;
+	}
+
+	if (--sd->cndtr == 0) {
+		if (ch->CCR & DMA_CCR_CIRC)
+			sd->cndtr = sd->reload;
+
+		if (ch == DMA1_Channel3) {
+			DMA1->ISR |= DMA_ISR_TCIF3 | DMA_ISR_GIF3;
+			if (ch->CCR & DMA_CCR_TCIE)
+				DMA1_Channel2_3_IRQHandler();
+		}
+	}
+
+	ch->CNDTR = sd->cndtr;
+}
+
+/** @brief Processes a trigger of DAC channel 1 by Timer 6.
+ *	@param t Time of the trigger in core clocks.
+ */
+static void dac_trigger(uint64_t t)
+{
+	if (!(DAC->CR & DAC_CR_EN1) || !(DAC->CR & DAC_CR_TEN1) ||
+		(DAC->CR & DAC_CR_TSEL1))
+		return;
+
+	DAC->DOR1 = sim_dac_dhr;
+	if (sim_dac_hook)
+		sim_dac_hook(t, sim_dac_dhr);
+
+	if (DAC->CR & DAC_CR_DMAEN1)
+		dma_request(&sim_dma3);
+}
+
+/** @brief Updates the counter of Timer 2.
+ *	@param t Current time in core clocks.
+ */
+static void tim2_sync(uint64_t t)
+{
+	uint32_t psc = (TIM2->PSC & 0xFFFF) + 1;
+
+	if (!(TIM2->CR1 & TIM_CR1_CEN)) {
+		sim_tim2_running = false;
+		return;
+	}
+
+	if (!sim_tim2_running || (TIM2->EGR & TIM_EGR_UG)) {
+		if (TIM2->EGR & TIM_EGR_UG)
+			TIM2->CNT = 0;
+		TIM2->EGR = 0;
+		sim_tim2_running = true;
+		sim_tim2_base = t - (uint64_t)TIM2->CNT * psc;
+	}
+
+	TIM2->CNT = (uint32_t)((t - sim_tim2_base) / psc);
+}
+
+/** @brief Resets the models.
+ *	@returns 0 if successful and -1 if the sample tables cannot be reached
+ *	through 32 bit addresses.
+ */
+int periph_init(void)
+{
+	if ((uintptr_t)&regs.dac > 0xFFFFFFFFu) {
+		fprintf(stderr, "Link the simulator with -no-pie\n");
+		return -1;
+	}
+
+	/* Reset values of the auto reload registers */
+	TIM6->ARR = 0xFFFF;
+	TIM7->ARR = 0xFFFF;
+	sim_tim6.arr = 0xFFFF;
+	sim_tim7.arr = 0xFFFF;
+
+	return 0;
+}
+
+/** @brief Picks up register writes done by the firmware.
+ */
+void periph_sync(void)
+{
+	timer_sync(&sim_tim6, sim_now);
+	timer_sync(&sim_tim7, sim_now);
+	tim2_sync(sim_now);
+	dma_sync(&sim_dma3);
+
+	if (SysTick->LOAD)
+		SysTick->VAL = sim_next_systick - sim_now - 1;
+}
+
+/** @brief Reads the simulated time.
+ *	@returns Core clocks since start.
+ */
+uint64_t periph_now(void)
+{
+	return sim_now;
+}
+
+/** @brief Runs the peripherals.
+ *	@param cycles Time to run to in core clocks since start.
+ */
+void periph_run_until(uint64_t cycles)
+{
+	struct sim_timer *st;
+	uint64_t next;
+
+	periph_sync();
+
+	while (1) {
+		st = NULL;
+		next = cycles;
+
+		if (sim_tim6.running && (sim_tim6.next_update <= next)) {
+			st = &sim_tim6;
+			next = st->next_update;
+		}
+		if (sim_tim7.running && (sim_tim7.next_update < next)) {
+			st = &sim_tim7;
+			next = st->next_update;
+		}
+
+		if (SysTick->LOAD && (sim_next_systick <= next)) {
+			sim_now = sim_next_systick;
+			sim_next_systick += SysTick->LOAD + 1;
+			SysTick_Handler();
+			periph_sync();
+			continue;
+		}
+
+		if (st == NULL)
+			break;
+
+		sim_now = next;
+		tim2_sync(next);
+		timer_update(st, next);
+		periph_sync();
+	}
+
+	sim_now = cycles;
+	periph_sync();
+}
+
+/** @brief Reads the output of DAC channel 1.
+ *	@param enabled Container for whether the channel is enabled.
+ *	@returns The DOR1 value.
+ */
+uint32_t periph_read_dac(bool *enabled)
+{
+	*enabled = DAC->CR & DAC_CR_EN1;
+	return DAC->DOR1;
+}
+
+/** @brief Sets a function called at every conversion of DAC channel 1.
+ *	@param hook The function, or NULL.
+ */
+void periph_set_dac_hook(void (*hook)(uint64_t cycles, uint32_t code))
+{
+	sim_dac_hook = hook;
+}
+
+#if defined(__linux__) && defined(__x86_64__)
+
+/** Trap flag of EFLAGS, single steps the next instruction */
+#define PERIPH_EFLAGS_TF		0x100
+
+/** Write bit of the page fault error code */
+#define PERIPH_FAULT_WRITE		0x2
+
+/** @brief Counts a register access and lets it through.
+ *	@param sig The signal.
+ *	@param info Fault address.
+ *	@param context Register state of the faulting instruction.
+ */
+static void count_fault(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+	uintptr_t addr = (uintptr_t)info->si_addr;
+
+	/* Not a register, crash as without the handler */
+	if (!sim_counting || (addr < (uintptr_t)&regs) ||
+		(addr >= (uintptr_t)&regs + sizeof(regs))) {
+		signal(sig, SIG_DFL);
+		return;
+	}
+
+	if (uc->uc_mcontext.gregs[REG_ERR] & PERIPH_FAULT_WRITE)
+		sim_count.writes++;
+	else
+		sim_count.reads++;
+
+	mprotect(&regs, sizeof(regs), PROT_READ | PROT_WRITE);
+	uc->uc_mcontext.gregs[REG_EFL] |= PERIPH_EFLAGS_TF;
+}
+
+/** @brief Protects the registers again after the access.
+ *	@param sig The signal.
+ *	@param info Unused.
+ *	@param context Register state after the access.
+ */
+static void count_step(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+
+	uc->uc_mcontext.gregs[REG_EFL] &= ~PERIPH_EFLAGS_TF;
+	if (sim_counting)
+		mprotect(&regs, sizeof(regs), PROT_NONE);
+}
+
+/** @brief Starts counting register accesses of the firmware.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Models must not run while counting, their accesses would be counted too.
+ */
+int periph_count_start(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+	sa.sa_sigaction = &count_fault;
+	if (sigaction(SIGSEGV, &sa, NULL))
+		return -1;
+	sa.sa_sigaction = &count_step;
+	if (sigaction(SIGTRAP, &sa, NULL))
+		return -1;
+
+	memset(&sim_count, 0, sizeof(sim_count));
+	sim_counting = 1;
+	if (mprotect(&regs, sizeof(regs), PROT_NONE)) {
+		sim_counting = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+/** @brief Stops counting register accesses.
+ *	@param count Container for the accesses since periph_count_start().
+ */
+void periph_count_stop(struct periph_count *count)
+{
+	sim_counting = 0;
+	mprotect(&regs, sizeof(regs), PROT_READ | PROT_WRITE);
+	*count = sim_count;
+}
+
+#else
+
+int periph_count_start(void)
+{
+	return -1;
+}
+
+void periph_count_stop(struct periph_count *count)
+{
+	memset(count, 0, sizeof(*count));
+}
+
+#endif
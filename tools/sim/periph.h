@@ -0,0 +1,36 @@
+
+/** @file periph.h
+ *  @brief Host peripheral models include file
+ */
+
+#ifndef PERIPH_H
+#define PERIPH_H
+
+#include <stdbool.h>
+#include "stm32f0xx.h"
+
+/** Simulated core clock in Hz */
+#define PERIPH_CLOCK_HZ			48000000ul
+
+/** Page size of the host, the registers are protected a page at a time */
+#define PERIPH_PAGE_SIZE		4096
+
+/** Register accesses counted between periph_count_start() and
+ *	periph_count_stop() */
+struct periph_count {
+	uint32_t reads;
+	uint32_t writes;
+};
+
+int periph_init(void);
+void periph_sync(void);
+uint64_t periph_now(void);
+void periph_run_until(uint64_t cycles);
+
+uint32_t periph_read_dac(bool *enabled);
+void periph_set_dac_hook(void (*hook)(uint64_t cycles, uint32_t code));
+
+int periph_count_start(void);
+void periph_count_stop(struct periph_count *count);
+
+#endif	/* PERIPH_H */
@@ -0,0 +1,229 @@
+
+/** @file profile.c
+ *  @brief Host profiler of the table planner
+ *
+ *	Runs prepare_waveform() of the firmware for every integer frequency from
+ *	MIN_FREQUENCY to MAX_FREQUENCY and every 0.1 V amplitude step, and prints
+ *	one CSV row per point:
+ *
+ *	- achieved_hz: frequency produced by the timer values and table
+ *	- error_ppm: signed error of achieved_hz against the request
+ *	- cycles: number of waveform cycles packed in the table
+ *	- samples_per_cycle, data_bits: table layout chosen by the planner
+ *	- ram_bytes: size of the table allocated from the arena
+ *	- build_ns: host time spent building the table, only with -b since it
+ *	  varies from run to run
+ *
+ *	Without -b the output only depends on the firmware code, so it can be
+ *	diffed against a stored copy to catch planner regressions. A summary goes
+ *	to stderr. The exit status is 1 if a point breaks a planner rule:
+ *
+ *	- frequencies in keep_12bit must use the 12-bit data path
+ *	- a table must keep PLAN_PACK_KEEP_PERCENT of the samples per cycle a
+ *	  single cycle fits at the fastest sample rate, so packing cycles does
+ *	  not trade away resolution for a few ppm
+ *
+ *	Build from the repository root:
+ *		gcc -O2 -no-pie -Itools/sim -I. -o profile tools/sim/periph.c \
+ *			tools/sim/profile.c wave_gen.c dma.c timer.c dac.c pwm.c arena.c \
+ *			systick.c trace.c serial.c baud.c freqmeter.c \
+ *			event.c -lm
+ *
+ *	Usage:
+ *		profile [-w wave] [-f min:max] [-b] > profile.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "periph.h"
+#include "wave_gen.h"
+#include "systick.h"
+
+/** Amplitude sweep step in 0.1 V */
+#define PROFILE_AMPLITUDE_STEPS_PER_V	10
+
+static const char *wave_names[] = {
+	"sine", "sawtooth", "triangle", "square", "harmonic"
+};
+
+/** Frequencies whose 12-bit table is already within PLAN_TOLERANCE_PPM, so
+ *	the 8-bit data path must not be taken for them */
+static const uint32_t keep_12bit[] = {17, 19, 36};
+
+/** @brief Checks a planned table against the planner rules.
+ *	@param frequency The requested frequency.
+ *	@param amplitude The requested amplitude in V.
+ *	@param slot The planned table.
+ *	@returns 0 if the table follows the rules and 1 if otherwise.
+ */
+static uint32_t check_rules(uint32_t frequency, float amplitude,
+	const struct waveform_slot *slot)
+{
+	uint32_t single;
+	unsigned int i;
+
+	/* Samples per cycle a single cycle table fits, as the planner finds */
+	single = get_max_sample_rate() / frequency;
+	if (single > ((slot->size == DMA_DATA_8BIT) ? MAX_MEMORY_ALLOWED_8BIT :
+		MAX_MEMORY_ALLOWED))
+		single = (slot->size == DMA_DATA_8BIT) ? MAX_MEMORY_ALLOWED_8BIT :
+			MAX_MEMORY_ALLOWED;
+	if ((slot->cycles > 1) && (slot->noofsample <
+		slot->cycles * (single * PLAN_PACK_KEEP_PERCENT / 100))) {
+		fprintf(stderr, "%u Hz %.1f V: %u samples per cycle, a single cycle "
+			"fits %u\n", frequency, amplitude,
+			slot->noofsample / slot->cycles, single);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(keep_12bit) / sizeof(keep_12bit[0]); i++) {
+		if ((frequency == keep_12bit[i]) && (slot->size == DMA_DATA_8BIT)) {
+			fprintf(stderr, "%u Hz %.1f V: 8-bit table, expected 12-bit\n",
+				frequency, amplitude);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/** @brief Reads the host monotonic clock.
+ *	@returns Time in ns.
+ */
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	struct waveform_slot slot;
+	enum waveform wave = SINE;
+	uint32_t min_freq = MIN_FREQUENCY;
+	uint32_t max_freq = MAX_FREQUENCY;
+	uint32_t frequency;
+	uint32_t points = 0;
+	uint32_t failed = 0;
+	uint32_t broken = 0;
+	uint32_t worst_freq = 0;
+	uint32_t min_samples = 0xFFFFFFFF;
+	uint32_t min_samples_freq = 0;
+	uint32_t ram;
+	uint32_t max_ram = 0;
+	uint64_t start;
+	uint64_t build_ns = 0;
+	double achieved;
+	double ppm;
+	double worst_ppm = 0.0;
+	double sum_ppm = 0.0;
+	bool timing = false;
+	unsigned int i;
+	int amp;
+	int opt;
+	uint8_t ok;
+
+	while ((opt = getopt(argc, argv, "w:f:b")) != -1) {
+		switch (opt) {
+		case 'w':
+			for (i = 0; i < sizeof(wave_names) / sizeof(wave_names[0]); i++) {
+				if (strcmp(optarg, wave_names[i]) == 0)
+					break;
+			}
+			if (i == sizeof(wave_names) / sizeof(wave_names[0])) {
+				fprintf(stderr, "Unknown waveform %s\n", optarg);
+				return 1;
+			}
+			wave = i;
+			break;
+		case 'f':
+			if (sscanf(optarg, "%u:%u", &min_freq, &max_freq) != 2) {
+				fprintf(stderr, "Bad frequency range %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'b':
+			timing = true;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-w wave] [-f min:max] [-b]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (periph_init())
+		return 1;
+	systick_init();
+
+	printf("wave,frequency_hz,amplitude_v,achieved_hz,error_ppm,"
+		"cycles,samples_per_cycle,data_bits,ram_bytes%s\n", timing ? ",build_ns" : "");
+
+	for (frequency = min_freq; frequency <= max_freq; frequency++) {
+		for (amp = MIN_AMPLITUDE_FLOAT * PROFILE_AMPLITUDE_STEPS_PER_V + 0.5;
+			amp <= MAX_AMPLITUDE_FLOAT * PROFILE_AMPLITUDE_STEPS_PER_V + 0.5;
+			amp++) {
+			points++;
+
+			start = host_ns();
+			ok = prepare_waveform(wave, frequency,
+					(float)amp / PROFILE_AMPLITUDE_STEPS_PER_V, 0.0,
+					MAX_MEMORY_ALLOWED, &slot);
+			build_ns = host_ns() - start;
+
+			if (!ok) {
+				failed++;
+				printf("%s,%u,%.1f,0,,0,0,0,0%s\n", wave_names[wave], frequency,
+					(float)amp / PROFILE_AMPLITUDE_STEPS_PER_V,
+					timing ? ",0" : "");
+				continue;
+			}
+
+			/* Timer counts ARR+1 ticks of PSC+1 core clocks per sample */
+			achieved = (double)SystemCoreClock * slot.cycles /
+				((double)(slot.timer_count + 1) * (slot.timer_prescalar + 1) *
+					slot.noofsample);
+			ppm = (achieved - frequency) * 1e6 / frequency;
+			ram = arena_block_size(slot.handle);
+			release_waveform(&slot);
+			broken += check_rules(frequency,
+				(float)amp / PROFILE_AMPLITUDE_STEPS_PER_V, &slot);
+
+			printf("%s,%u,%.1f,%.6f,%.3f,%u,%.2f,%u,%u", wave_names[wave],
+				frequency, (float)amp / PROFILE_AMPLITUDE_STEPS_PER_V,
+				achieved, ppm, slot.cycles,
+				(double)slot.noofsample / slot.cycles,
+				(slot.size == DMA_DATA_8BIT) ? 8 : 12, ram);
+			if (timing)
+				printf(",%llu", (unsigned long long)build_ns);
+			printf("\n");
+
+			sum_ppm += (ppm < 0) ? -ppm : ppm;
+			if (((ppm < 0) ? -ppm : ppm) > ((worst_ppm < 0) ? -worst_ppm : worst_ppm)) {
+				worst_ppm = ppm;
+				worst_freq = frequency;
+			}
+			if (slot.noofsample / slot.cycles < min_samples) {
+				min_samples = slot.noofsample / slot.cycles;
+				min_samples_freq = frequency;
+			}
+			if (ram > max_ram)
+				max_ram = ram;
+		}
+	}
+
+	fprintf(stderr, "%u points, %u failed\n", points, failed);
+	if (points > failed) {
+		fprintf(stderr, "mean |error| %.1f ppm, worst %.1f ppm at %u Hz\n",
+			sum_ppm / (points - failed), worst_ppm, worst_freq);
+		fprintf(stderr, "fewest samples per cycle %u at %u Hz, largest table "
+			"%u bytes\n", min_samples, min_samples_freq, max_ram);
+	}
+	fprintf(stderr, "%u points break a planner rule\n", broken);
+
+	return broken ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+
+/** @file regbench.c
+ *  @brief Host count of the register accesses of configure_dac()
+ *
+ *	Counts the peripheral register reads and writes of configure_dac() for a
+ *	start, a swap to another table, a swap to the 8 bit data path and a new
+ *	period on the same table. Each is counted for configure_dac() as it is,
+ *	on the fixed channel driver variants, and for configure_dac_checked(),
+ *	a copy of configure_dac() as it was on the checked driver calls. Both
+ *	start from the same output state.
+ *
+ *	The accesses are counted by the peripheral models, see periph.c, so
+ *	this runs on Linux x86-64 only. configure_dac() reads the SysTick
+ *	counter twice to time itself. These reads are counted too, and are
+ *	printed on their own below the table.
+ *
+ *	configure_dac() is static, so this file includes wave_gen.c instead of
+ *	linking it. Build from the repository root:
+ *		gcc -O2 -no-pie -Itools/sim -I. -o regbench tools/sim/periph.c \
+ *			tools/sim/regbench.c dma.c timer.c dac.c pwm.c arena.c \
+ *			systick.c trace.c serial.c baud.c freqmeter.c \
+ *			event.c -lm
+ */
+
+#include <stdio.h>
+#include "periph.h"
+#include "wave_gen.c"
+
+/** Samples in each table */
+#define REGBENCH_SAMPLE			1000
+
+/** One configuration counted */
+struct regbench_path {
+	const char *name;
+	const struct waveform_slot *from;	/** Slot played before, NULL if stopped */
+	const struct waveform_slot *to;
+};
+
+static uint32_t table_a[REGBENCH_SAMPLE];
+static uint32_t table_b[REGBENCH_SAMPLE];
+
+/** @brief configure_dac() as it was on the checked driver calls.
+ *	@param slot The table and timer values to play.
+ *
+ *	Every call checks the channel and looks up the base pointer, the DMA
+ *	channel is set up in full and the timer written on every swap.
+ */
+static void configure_dac_checked(const struct waveform_slot *slot)
+{
+	const uint32_t *table;
+
+	trace_event(TRACE_DAC_CONFIG, ((playing_slot.noofsample == 0) << 23) |
+		slot->noofsample);
+
+	table = slot->table ? slot->table : arena_ptr(slot->handle);
+
+	dma_disable(DMA_CHN);
+
+	if (playing_slot.noofsample == 0) {
+		timer_disable(TIMER_IDX);
+
+		dac_disable(DAC_CHN);
+		dac_init(DAC_CHN);
+		dac_enable(DAC_CHN);
+		dac_enable_underrun_interrupt(DAC_CHN, &recover_underrun);
+
+		timer_init(TIMER_IDX, 0, 0);
+	}
+
+	dma_init(DMA_CHN, table, slot->noofsample, slot->size);
+	dma_enable(DMA_CHN);
+
+	timer_write_counter(TIMER_IDX, slot->timer_count);
+	timer_write_prescaler(TIMER_IDX, slot->timer_prescalar);
+	timer_enable(TIMER_IDX);
+
+	playing_slot = *slot;
+	playing_slot.table = table;
+	freqmeter_start(slot->noofsample, slot->cycles);
+}
+
+/** @brief Counts the register accesses of one configuration.
+ *	@param configure The configure function.
+ *	@param path The configuration.
+ *	@param count Container for the accesses.
+ *	@returns 0 if successful and -1 if accesses cannot be counted.
+ */
+static int count_path(void (*configure)(const struct waveform_slot *),
+	const struct regbench_path *path, struct periph_count *count)
+{
+	stop_waveform();
+	output_halted = 0;
+	if (path->from)
+		configure(path->from);
+
+	if (periph_count_start())
+		return -1;
+	configure(path->to);
+	periph_count_stop(count);
+
+	return 0;
+}
+
+int main(void)
+{
+	static const struct waveform_slot slot_a = {-1, REGBENCH_SAMPLE, 1, 0,
+		1000, 0, DMA_DATA_12BIT, 47, 0, table_a};
+	static const struct waveform_slot slot_b = {-1, REGBENCH_SAMPLE, 1, 0,
+		1000, 0, DMA_DATA_12BIT, 47, 0, table_b};
+	static const struct waveform_slot slot_8bit = {-1, REGBENCH_SAMPLE, 1, 0,
+		1000, 0, DMA_DATA_8BIT, 47, 0, table_b};
+	static const struct waveform_slot slot_retimed = {-1, REGBENCH_SAMPLE, 1, 0,
+		1010, 0, DMA_DATA_12BIT, 46, 0, table_a};
+	static const struct regbench_path paths[] = {
+		{"start", NULL, &slot_a},
+		{"table swap", &slot_a, &slot_b},
+		{"8 bit swap", &slot_a, &slot_8bit},
+		{"new period", &slot_a, &slot_retimed},
+	};
+	struct periph_count checked;
+	struct periph_count fixed;
+	struct periph_count timing;
+	unsigned int i;
+
+	if (periph_init())
+		return 1;
+	systick_init();
+
+	printf("path          checked rd  wr   fixed rd  wr\n");
+	for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+		if (count_path(&configure_dac_checked, &paths[i], &checked) ||
+			count_path(&configure_dac, &paths[i], &fixed)) {
+			fprintf(stderr, "Register accesses cannot be counted here\n");
+			return 1;
+		}
+
+		printf("%-12s  %10u %3u  %8u %3u\n", paths[i].name, checked.reads,
+			checked.writes, fixed.reads, fixed.writes);
+	}
+
+	periph_count_start();
+	systick_get_cycles();
+	systick_get_cycles();
+	periph_count_stop(&timing);
+	printf("\nfixed includes %u reads and %u writes timing configure_dac()\n",
+		timing.reads, timing.writes);
+
+	return 0;
+}
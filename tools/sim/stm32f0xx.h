@@ -0,0 +1,252 @@
+
+/** @file stm32f0xx.h
+ *  @brief Mock device header for host builds
+ *
+ *	Replaces the CMSIS device header when the firmware sources are built on
+ *	the host. Peripherals are plain structures with the register layout used
+ *	by the drivers, and the peripheral pointers point at instances defined in
+ *	periph.c. Only the registers and bits used by the firmware are defined.
+ */
+
+#ifndef STM32F0XX_H
+#define STM32F0XX_H
+
+#include <stdint.h>
+
+#define __IO volatile
+
+/** Interrupt numbers */
+typedef enum {
+	SysTick_IRQn				= -1,
+	DMA1_Channel2_3_IRQn		= 10,
+	DMA1_Channel4_5_6_7_IRQn	= 11,
+	TIM2_IRQn					= 15,
+	TIM3_IRQn					= 16,
+	TIM6_DAC_IRQn				= 17,
+	TIM7_IRQn					= 18,
+	USART2_IRQn					= 28
+} IRQn_Type;
+
+/** @name Peripheral register layouts */
+/** @{*/
+
+typedef struct {
+	__IO uint32_t CR, CFGR, CIR, APB2RSTR, APB1RSTR, AHBENR, APB2ENR, APB1ENR;
+	__IO uint32_t BDCR, CSR, AHBRSTR, CFGR2, CFGR3, CR2;
+} RCC_TypeDef;
+
+typedef struct {
+	__IO uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR;
+	__IO uint32_t AFR[2], BRR;
+} GPIO_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR, SWTRIGR, DHR12R1, DHR12L1, DHR8R1, DHR12R2, DHR12L2;
+	__IO uint32_t DHR8R2, DHR12RD, DHR12LD, DHR8RD, DOR1, DOR2, SR;
+} DAC_TypeDef;
+
+typedef struct {
+	__IO uint32_t CCR, CNDTR, CPAR, CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+	__IO uint32_t ISR, IFCR;
+} DMA_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC;
+	__IO uint32_t ARR, RCR, CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR, OR;
+} TIM_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR1, CR2, CR3, BRR, GTPR, RTOR, RQR, ISR, ICR, RDR, TDR;
+} USART_TypeDef;
+
+typedef struct {
+	__IO uint32_t ACR, KEYR, OPTKEYR, SR, CR, AR, RESERVED, OBR, WRPR;
+} FLASH_TypeDef;
+
+typedef struct {
+	__IO uint32_t CTRL, LOAD, VAL, CALIB;
+} SysTick_Type;
+
+typedef struct {
+	__IO uint32_t CPUID, ICSR, RESERVED0, AIRCR, SCR, CCR;
+} SCB_Type;
+
+/** @}*/
+
+/** @name Peripheral instances */
+/** @{*/
+
+extern RCC_TypeDef *RCC;
+extern GPIO_TypeDef *GPIOA, *GPIOB, *GPIOC;
+extern DAC_TypeDef *DAC;
+extern DMA_TypeDef *DMA1;
+extern DMA_Channel_TypeDef *DMA1_Channel3, *DMA1_Channel4;
+extern TIM_TypeDef *TIM2, *TIM3, *TIM6, *TIM7;
+extern USART_TypeDef *USART2;
+extern FLASH_TypeDef *FLASH;
+extern SysTick_Type *SysTick;
+extern SCB_Type *SCB;
+
+/** @}*/
+
+/** @name System and core functions */
+/** @{*/
+
+extern uint32_t SystemCoreClock;
+void SystemCoreClockUpdate(void);
+
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+uint32_t SysTick_Config(uint32_t ticks);
+
+void __WFI(void);
+void __NOP(void);
+void __DSB(void);
+void __ISB(void);
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+
+/** @}*/
+
+/** @name Register bits */
+/** @{*/
+
+#define FLASH_BASE 0x08000000UL
+#define RCC_CR_HSION 1
+#define RCC_CR_HSIRDY 2
+#define RCC_CR_PLLON (1<<24)
+#define RCC_CR_PLLRDY (1<<25)
+#define RCC_CFGR_SW 3
+#define RCC_CFGR_SW_HSI 0
+#define RCC_CFGR_SW_PLL 2
+#define RCC_CFGR_SWS 0xC
+#define RCC_CFGR_SWS_HSI 0
+#define RCC_CFGR_SWS_PLL 8
+#define RCC_CFGR_HPRE_DIV1 0
+#define RCC_CFGR_PPRE_DIV1 0
+#define RCC_CFGR_PLLSRC (1<<16)
+#define RCC_CFGR_PLLXTPRE (1<<17)
+#define RCC_CFGR_PLLMULL (0xF<<18)
+#define RCC_CFGR_PLLSRC_HSI_Div2 0
+#define RCC_CFGR_PLLMULL12 (0xA<<18)
+#define FLASH_ACR_PRFTBE 0x10
+#define FLASH_ACR_LATENCY 1
+#define RCC_AHBENR_DMA1EN 1
+#define RCC_AHBENR_GPIOAEN (1<<17)
+#define RCC_AHBENR_GPIOBEN (1<<18)
+#define RCC_AHBENR_GPIOCEN (1<<19)
+#define RCC_APB1ENR_TIM2EN 1
+#define RCC_APB1ENR_TIM3EN 2
+#define RCC_APB1ENR_TIM6EN 0x10
+#define RCC_APB1ENR_TIM7EN 0x20
+#define RCC_APB1ENR_USART2EN (1<<17)
+#define RCC_APB1ENR_DACEN (1<<29)
+#define GPIO_MODER_MODER4 (3<<8)
+#define GPIO_MODER_MODER5 (3<<10)
+#define GPIO_MODER_MODER6 (3<<12)
+#define GPIO_MODER_MODER8 (3<<16)
+#define GPIO_PUPDR_PUPDR4 (3<<8)
+#define GPIO_PUPDR_PUPDR5 (3<<10)
+#define DAC_CR_EN1 1
+#define DAC_CR_BOFF1 2
+#define DAC_CR_TEN1 4
+#define DAC_CR_TSEL1 0x38
+#define DAC_CR_DMAEN1 0x1000
+#define DAC_CR_DMAUDRIE1 0x2000
+#define DAC_CR_EN2 0x10000
+#define DAC_CR_BOFF2 0x20000
+#define DAC_CR_TEN2 0x40000
+#define DAC_CR_TSEL2 0x380000
+#define DAC_CR_TSEL2_1 0x100000
+#define DAC_CR_DMAEN2 0x10000000
+#define DAC_CR_DMAUDRIE2 0x20000000
+#define DAC_SR_DMAUDR1 0x2000
+#define DAC_SR_DMAUDR2 0x20000000
+#define DMA_CCR_EN 1
+#define DMA_CCR_TCIE 2
+#define DMA_CCR_HTIE 4
+#define DMA_CCR_TEIE 8
+#define DMA_CCR_DIR 0x10
+#define DMA_CCR_CIRC 0x20
+#define DMA_CCR_PINC 0x40
+#define DMA_CCR_MINC 0x80
+#define DMA_CCR_PSIZE 0x300
+#define DMA_CCR_PSIZE_0 0x100
+#define DMA_CCR_PSIZE_1 0x200
+#define DMA_CCR_MSIZE 0xC00
+#define DMA_CCR_MSIZE_0 0x400
+#define DMA_CCR_MSIZE_1 0x800
+#define DMA_CCR_PL 0x3000
+#define DMA_CCR_PL_0 0x1000
+#define DMA_CCR_PL_1 0x2000
+#define DMA_CCR_MEM2MEM 0x4000
+#define DMA_ISR_GIF3 0x100
+#define DMA_ISR_TCIF3 0x200
+#define DMA_ISR_HTIF3 0x400
+#define DMA_ISR_TEIF3 0x800
+#define DMA_ISR_GIF4 0x1000
+#define DMA_ISR_TCIF4 0x2000
+#define DMA_ISR_HTIF4 0x4000
+#define DMA_ISR_TEIF4 0x8000
+#define DMA_IFCR_CGIF3 0x100
+#define DMA_IFCR_CTCIF3 0x200
+#define DMA_IFCR_CGIF4 0x1000
+#define DMA_IFCR_CTCIF4 0x2000
+#define TIM_CR1_CEN 1
+#define TIM_CR1_UDIS 2
+#define TIM_CR1_URS 4
+#define TIM_CR1_OPM 8
+#define TIM_CR1_ARPE 0x80
+#define TIM_CR2_MMS 0x70
+#define TIM_CR2_MMS_1 0x20
+#define TIM_DIER_UIE 1
+#define TIM_DIER_UDE 0x100
+#define TIM_SR_UIF 1
+#define TIM_EGR_UG 1
+#define TIM_CCMR1_OC1M 0x70
+#define TIM_CCMR1_OC1M_1 0x20
+#define TIM_CCMR1_OC1M_2 0x40
+#define TIM_CCMR1_OC1PE 0x8
+#define TIM_CCER_CC1E 1
+#define USART_CR1_UE 1
+#define USART_CR1_RE 4
+#define USART_CR1_TE 8
+#define USART_CR1_RXNEIE 0x20
+#define USART_CR1_TCIE 0x40
+#define USART_CR1_TXEIE 0x80
+#define USART_CR1_OVER8 0x8000
+#define USART_ISR_PE 1
+#define USART_ISR_FE 2
+#define USART_ISR_NE 4
+#define USART_ISR_ORE 8
+#define USART_ISR_RXNE 0x20
+#define USART_ISR_TC 0x40
+#define USART_ISR_TXE 0x80
+#define USART_ICR_ORECF 8
+#define FLASH_KEY1 0x45670123UL
+#define FLASH_KEY2 0xCDEF89ABUL
+#define FLASH_SR_BSY 1
+#define FLASH_SR_PGERR 4
+#define FLASH_SR_WRPERR 0x10
+#define FLASH_SR_EOP 0x20
+#define FLASH_CR_PG 1
+#define FLASH_CR_PER 2
+#define FLASH_CR_STRT 0x40
+#define FLASH_CR_LOCK 0x80
+#define SysTick_CTRL_ENABLE_Msk 1
+#define SysTick_CTRL_TICKINT_Msk 2
+#define SysTick_CTRL_CLKSOURCE_Msk 4
+#define SysTick_CTRL_COUNTFLAG_Msk 0x10000
+#define SysTick_LOAD_RELOAD_Msk 0xFFFFFF
+#define SCB_SCR_SLEEPONEXIT_Msk 2
+#define SCB_ICSR_PENDSTSET_Msk (1UL<<26)
+
+/** @}*/
+
+#endif	/* STM32F0XX_H */
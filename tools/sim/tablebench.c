@@ -0,0 +1,347 @@
+
+/** @file tablebench.c
+ *  @brief Host check and benchmark of the table builders
+ *
+ *	Compares the tables built by generate_sawtooth_table() and
+ *	generate_triangular_table() against reference builders that divide for
+ *	every sample, as the firmware did before, over table sizes, packed cycle
+ *	counts and amplitudes. Any sample that differs is reported and the exit
+ *	status is 1. The builders run GENERATE_CHUNK_SAMPLES at a time as in
+ *	continue_generate(), so resuming in the middle of a table is checked
+ *	too.
+ *
+ *	generate_harmonic_table() is checked the same way on full size tables
+ *	with several harmonics, against a reference summing sin() in double
+ *	precision and normalised to the peaks. Its samples must stay below
+ *	DAC_RESOLUTION and within HARMONIC_TOLERANCE codes of the reference.
+ *
+ *	Then times each builder against its reference on a few table sizes.
+ *
+ *	The builders are static, so this file includes wave_gen.c instead of
+ *	linking it. Build from the repository root:
+ *		gcc -O2 -no-pie -Itools/sim -I. -o tablebench tools/sim/periph.c \
+ *			tools/sim/tablebench.c dma.c timer.c dac.c pwm.c arena.c \
+ *			systick.c trace.c serial.c baud.c freqmeter.c \
+ *			event.c -lm
+ *
+ *	Host timings only show the relative cost. On the Cortex-M0 every divide
+ *	of the reference is a call to the runtime library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include "wave_gen.c"
+
+/** Largest table checked, in samples */
+#define BENCH_MAX_SAMPLE		MAX_MEMORY_ALLOWED_8BIT
+
+/** Table sizes up to this are all checked, larger ones are sampled */
+#define BENCH_DENSE_SAMPLE		1024
+
+/** Step between the sampled larger table sizes */
+#define BENCH_SPARSE_STEP		97
+
+/** Times each table is built in the benchmark */
+#define BENCH_ROUNDS			200
+
+/** Size of the harmonic tables checked, the largest 12 bit table */
+#define HARMONIC_SAMPLE			MAX_MEMORY_ALLOWED
+
+/** Largest difference in codes of a harmonic sample from the reference */
+#define HARMONIC_TOLERANCE		4
+
+/** Harmonic contents checked */
+static const struct harmonic harmonic_sets[][MAX_HARMONICS] = {
+	{{1, 100, 0}},
+	{{1, 100, 0}, {3, 33, 0}, {5, 20, 0}, {7, 14, 0}},
+	{{1, 100, 0}, {2, 50, 90}, {3, 30, 45}, {4, 25, 180}, {5, 20, 270}},
+	{{1, 100, 0}, {2, 100, 0}, {3, 100, 0}, {5, 100, 0}, {8, 100, 0},
+		{13, 100, 0}, {21, 100, 0}, {MAX_HARMONIC_ORDER, 100, 0}},
+};
+
+/** Number of harmonics of each set in harmonic_sets */
+static const uint32_t harmonic_set_count[] = {1, 4, 5, MAX_HARMONICS};
+
+static const char *wave_names[] = {
+	"sine", "sawtooth", "triangle", "square", "harmonic"
+};
+
+static uint32_t reference[BENCH_MAX_SAMPLE];
+static uint32_t built[BENCH_MAX_SAMPLE];
+
+/** Largest difference of a harmonic sample from the reference seen */
+static uint32_t harmonic_worst;
+
+/** @brief Reference sawtooth builder dividing for every sample.
+ *	@param n Number of samples.
+ *	@param cycles Number of waveform cycles in the table.
+ *	@param amp Amplitude in DAC resolution.
+ */
+static void ref_sawtooth(uint32_t n, uint32_t cycles, uint32_t amp)
+{
+	uint32_t i;
+	uint32_t position = 0;
+
+	for (i = 0; i < n; i++) {
+		store_sample(i, amp * position / n);
+		position += cycles;
+		if (position >= n)
+			position -= n;
+	}
+}
+
+/** @brief Reference triangle builder dividing for every sample.
+ *	@param n Number of samples.
+ *	@param cycles Number of waveform cycles in the table.
+ *	@param amp Amplitude in DAC resolution.
+ */
+static void ref_triangle(uint32_t n, uint32_t cycles, uint32_t amp)
+{
+	uint32_t i;
+	uint32_t position = 0;
+
+	for (i = 0; i < n; i++) {
+		if (position < n / 2)
+			store_sample(i, 2 * (amp * position / n));
+		else
+			store_sample(i, amp - (2 * (amp * (position - n / 2) / n)));
+		position += cycles;
+		if (position >= n)
+			position -= n;
+	}
+}
+
+/** @brief Reference harmonic builder summing sin() in double precision.
+ *	@param n Number of samples.
+ *	@param cycles Number of waveform cycles in the table.
+ *	@param amp Amplitude in DAC resolution.
+ *
+ *	Sums the harmonics set with set_harmonics() and scales the sum so its
+ *	peaks are 0 and amp.
+ */
+static void ref_harmonic(uint32_t n, uint32_t cycles, uint32_t amp)
+{
+	static double sum[HARMONIC_SAMPLE];
+	double angle;
+	double min = 0.0;
+	double max = 0.0;
+	uint32_t i;
+	uint32_t h;
+
+	for (i = 0; i < n; i++) {
+		sum[i] = 0.0;
+		for (h = 0; h < harmonic_count; h++) {
+			angle = 2.0 * M_PI * ((double)harmonic_list[h].order * cycles * i / n +
+				harmonic_list[h].phase / 360.0);
+			sum[i] += harmonic_list[h].amplitude * sin(angle);
+		}
+		if ((i == 0) || (sum[i] < min))
+			min = sum[i];
+		if ((i == 0) || (sum[i] > max))
+			max = sum[i];
+	}
+
+	for (i = 0; i < n; i++)
+		store_sample(i, (max > min) ?
+			(uint32_t)((sum[i] - min) * amp / (max - min) + 0.5) : 0);
+}
+
+/** @brief Builds a table through store_sample() as the firmware does.
+ *	@param table Container for the samples.
+ *	@param ref true to use the reference builder.
+ *	@param wave SAWTOOTH, TRIANGLE or HARMONIC.
+ *	@param n Number of samples.
+ *	@param cycles Number of waveform cycles in the table.
+ *	@param amp Amplitude in DAC resolution.
+ */
+static void build(uint32_t *table, bool ref, enum waveform wave, uint32_t n,
+	uint32_t cycles, uint32_t amp)
+{
+	uint32_t first;
+	uint32_t end;
+
+	table_data = table;
+	table_size = DMA_DATA_12BIT;
+	offset_in_resolution = 0;
+
+	if (ref && (wave == SAWTOOTH))
+		ref_sawtooth(n, cycles, amp);
+	else if (ref && (wave == TRIANGLE))
+		ref_triangle(n, cycles, amp);
+	else if (ref)
+		ref_harmonic(n, cycles, amp);
+	else {
+		/* The harmonic builder takes two steps per sample */
+		for (first = 0; first < table_steps(wave, n); first = end) {
+			end = first + GENERATE_CHUNK_SAMPLES;
+			if (end > table_steps(wave, n))
+				end = table_steps(wave, n);
+			if (wave == SAWTOOTH)
+				generate_sawtooth_table(n, cycles, amp, first, end);
+			else if (wave == TRIANGLE)
+				generate_triangular_table(n, cycles, amp, first, end);
+			else
+				generate_harmonic_table(n, cycles, amp, first, end);
+		}
+	}
+}
+
+/** @brief Compares one table against the reference.
+ *	@returns Number of samples that differ.
+ */
+static uint32_t check(enum waveform wave, uint32_t n, uint32_t cycles, uint32_t amp)
+{
+	uint32_t i;
+	uint32_t bad = 0;
+
+	build(reference, true, wave, n, cycles, amp);
+	build(built, false, wave, n, cycles, amp);
+
+	for (i = 0; i < n; i++) {
+		if (built[i] != reference[i]) {
+			if (bad == 0)
+				printf("%s n=%u cycles=%u amp=%u: sample %u is %u, "
+					"expected %u\n", (wave == SAWTOOTH) ? "sawtooth" :
+					"triangle", n, cycles, amp, i, built[i], reference[i]);
+			bad++;
+		}
+	}
+
+	return bad;
+}
+
+/** @brief Compares one harmonic table against the reference.
+ *	@returns Number of samples out of range or off by more than
+ *	HARMONIC_TOLERANCE.
+ */
+static uint32_t check_harmonic(uint32_t set, uint32_t n, uint32_t cycles,
+	uint32_t amp)
+{
+	uint32_t i;
+	uint32_t bad = 0;
+	uint32_t worst = 0;
+	uint32_t diff;
+
+	set_harmonics(harmonic_sets[set], harmonic_set_count[set]);
+	build(reference, true, HARMONIC, n, cycles, amp);
+	build(built, false, HARMONIC, n, cycles, amp);
+
+	for (i = 0; i < n; i++) {
+		diff = abs((int32_t)built[i] - (int32_t)reference[i]);
+		if (diff > worst)
+			worst = diff;
+		if ((built[i] >= DAC_RESOLUTION) || (built[i] > amp) ||
+			(diff > HARMONIC_TOLERANCE)) {
+			if (bad == 0)
+				printf("harmonic set %u n=%u cycles=%u amp=%u: sample %u "
+					"is %u, expected %u\n", set, n, cycles, amp, i,
+					built[i], reference[i]);
+			bad++;
+		}
+	}
+
+	if (worst > harmonic_worst)
+		harmonic_worst = worst;
+
+	return bad;
+}
+
+/** @brief Reads the host monotonic clock.
+ *	@returns Time in ns.
+ */
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** @brief Times the reference and firmware builders on one table size.
+ *	@param wave SAWTOOTH, TRIANGLE or HARMONIC.
+ *	@param n Number of samples.
+ */
+static void bench(enum waveform wave, uint32_t n)
+{
+	uint32_t amp = DAC_RESOLUTION - 1;
+	uint64_t start;
+	uint64_t ref_ns;
+	uint64_t new_ns;
+	int i;
+
+	start = host_ns();
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		build(reference, true, wave, n, 1, amp - (i & 1));
+	ref_ns = host_ns() - start;
+
+	start = host_ns();
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		build(built, false, wave, n, 1, amp - (i & 1));
+	new_ns = host_ns() - start;
+
+	printf("%-8s %6u  %10.2f  %10.2f\n", wave_names[wave], n, (double)ref_ns / BENCH_ROUNDS / n,
+		(double)new_ns / BENCH_ROUNDS / n);
+}
+
+int main(void)
+{
+	static const uint32_t cycle_list[] = {1, 2, 3, 7, MAX_TABLE_CYCLES};
+	static const uint32_t bench_sizes[] = {64, 1000, BENCH_MAX_SAMPLE};
+	enum waveform wave;
+	uint32_t tables = 0;
+	uint32_t bad = 0;
+	uint32_t harmonic_bad;
+	uint32_t n;
+	uint32_t amp;
+	unsigned int c;
+	unsigned int i;
+
+	for (wave = SAWTOOTH; wave <= TRIANGLE; wave++) {
+		for (n = 2; n <= BENCH_MAX_SAMPLE;
+			n += (n < BENCH_DENSE_SAMPLE) ? 1 : BENCH_SPARSE_STEP) {
+			for (c = 0; c < sizeof(cycle_list) / sizeof(cycle_list[0]); c++) {
+				if (cycle_list[c] >= n)
+					continue;
+				for (amp = 0; amp < DAC_RESOLUTION; amp += 63) {
+					bad += check(wave, n, cycle_list[c], amp) ? 1 : 0;
+					tables++;
+				}
+				bad += check(wave, n, cycle_list[c], DAC_RESOLUTION - 1) ? 1 : 0;
+				tables++;
+			}
+		}
+	}
+
+	printf("%u tables checked, %u differ\n", tables, bad);
+
+	tables = 0;
+	harmonic_bad = 0;
+	for (i = 0; i < sizeof(harmonic_set_count) / sizeof(harmonic_set_count[0]); i++) {
+		for (c = 0; c < sizeof(cycle_list) / sizeof(cycle_list[0]); c++) {
+			for (amp = 0; amp < DAC_RESOLUTION; amp += 455) {
+				harmonic_bad += check_harmonic(i, HARMONIC_SAMPLE,
+					cycle_list[c], amp) ? 1 : 0;
+				tables++;
+			}
+			harmonic_bad += check_harmonic(i, HARMONIC_SAMPLE, cycle_list[c],
+				DAC_RESOLUTION - 1) ? 1 : 0;
+			tables++;
+		}
+	}
+
+	printf("%u harmonic tables checked, %u out of tolerance, worst %u codes\n\n",
+		tables, harmonic_bad, harmonic_worst);
+	bad += harmonic_bad;
+
+	printf("builder   samples  ref ns/smp  new ns/smp\n");
+	for (wave = SAWTOOTH; wave <= TRIANGLE; wave++) {
+		for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+			bench(wave, bench_sizes[i]);
+	}
+	set_harmonics(harmonic_sets[1], harmonic_set_count[1]);
+	bench(HARMONIC, HARMONIC_SAMPLE);
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,294 @@
+
+/** @file wavesim.c
+ *  @brief Host simulator of the DAC output
+ *
+ *	Runs the firmware waveform code against the peripheral models in
+ *	periph.c and streams the DAC output to a WAV or CSV file. Each setting on
+ *	the command line is applied with generate_waveform() in turn and played
+ *	for the given time, so changes between settings are simulated as on the
+ *	device. Output is written as it is produced and memory use does not grow
+ *	with the length of the run.
+ *
+ *	A summary of every setting is printed: the DAC code range, the frequency
+ *	measured from crossings of the mid level and the largest step between two
+ *	conversions, which shows any jump at the change into the setting. With
+ *	-s the run fails when any setting after the first steps by more than the
+ *	given number of codes, so a phase jump at a rebuild is caught. Several
+ *	settings that only move the offset rebuild the table back to back:
+ *		wavesim -s 64 -t 0.2 -c -o out.csv sine:100:2.0:0 sine:100:2.0:0.01 \
+ *			sine:100:2.0:0.02 sine:100:2.0:0.03 sine:100:2.0:0.04
+ *
+ *	Build from the repository root:
+ *		gcc -O2 -no-pie -Itools/sim -I. -o wavesim tools/sim/periph.c \
+ *			tools/sim/wavesim.c wave_gen.c dma.c timer.c dac.c pwm.c arena.c \
+ *			systick.c trace.c serial.c baud.c freqmeter.c \
+ *			event.c -lm
+ *
+ *	Usage:
+ *		wavesim [-t seconds] [-r rate] [-s step] [-c] -o file wave:freq:amp[:offset] ...
+ *
+ *	wave is one of sine, sawtooth, triangle, square or harmonic. -r sets the
+ *	output sample rate (48000 by default), -c writes CSV instead of WAV.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "periph.h"
+#include "wave_gen.h"
+#include "systick.h"
+
+/** Default output sample rate in Hz */
+#define SIM_DEFAULT_RATE		48000
+
+/** Default time each setting is played in seconds */
+#define SIM_DEFAULT_SECONDS		1.0
+
+/** One setting from the command line */
+struct sim_setting {
+	enum waveform wave;
+	uint32_t frequency;
+	float amplitude;
+	float offset;
+};
+
+/** Output statistics of a setting */
+struct sim_stats {
+	uint32_t conversions;
+	uint32_t min;
+	uint32_t max;
+	uint32_t max_step;
+	uint32_t crossings;
+	uint64_t first_crossing;
+	uint64_t last_crossing;
+	int32_t last_code;			/** -1 before the first conversion */
+};
+
+static const char *wave_names[] = {
+	"sine", "sawtooth", "triangle", "square", "harmonic"
+};
+
+static struct sim_stats stats;
+
+/** @brief Writes a little endian value to a file.
+ *	@param f The file.
+ *	@param val The value.
+ *	@param bytes Number of bytes to write.
+ */
+static void write_le(FILE *f, uint32_t val, int bytes)
+{
+	while (bytes--) {
+		fputc(val & 0xFF, f);
+		val >>= 8;
+	}
+}
+
+/** @brief Writes a mono 16 bit WAV header.
+ *	@param f The file.
+ *	@param rate Sample rate in Hz.
+ *	@param samples Number of samples, patched in when the run ends.
+ */
+static void write_wav_header(FILE *f, uint32_t rate, uint32_t samples)
+{
+	fwrite("RIFF", 1, 4, f);
+	write_le(f, 36 + samples * 2, 4);
+	fwrite("WAVEfmt ", 1, 8, f);
+	write_le(f, 16, 4);
+	write_le(f, 1, 2);			/* PCM */
+	write_le(f, 1, 2);			/* mono */
+	write_le(f, rate, 4);
+	write_le(f, rate * 2, 4);
+	write_le(f, 2, 2);
+	write_le(f, 16, 2);
+	fwrite("data", 1, 4, f);
+	write_le(f, samples * 2, 4);
+}
+
+/** @brief Collects statistics of every DAC conversion.
+ *	@param cycles Time of the conversion in core clocks.
+ *	@param code The converted code.
+ */
+static void record_conversion(uint64_t cycles, uint32_t code)
+{
+	uint32_t step;
+	uint32_t mid;
+
+	mid = (stats.min + stats.max) / 2;
+
+	if (stats.last_code >= 0) {
+		step = abs((int32_t)code - stats.last_code);
+		if (step > stats.max_step)
+			stats.max_step = step;
+
+		/* Rising crossings of the level seen so far */
+		if ((stats.conversions > 1) && (stats.last_code < mid) && (code >= mid)) {
+			if (stats.crossings == 0)
+				stats.first_crossing = cycles;
+			stats.last_crossing = cycles;
+			stats.crossings++;
+		}
+	}
+
+	if (stats.conversions == 0 || code < stats.min)
+		stats.min = code;
+	if (stats.conversions == 0 || code > stats.max)
+		stats.max = code;
+
+	stats.last_code = code;
+	stats.conversions++;
+}
+
+/** @brief Parses a setting.
+ *	@param arg Setting in the form wave:freq:amp[:offset].
+ *	@param setting Container for the setting.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+static int parse_setting(const char *arg, struct sim_setting *setting)
+{
+	char name[16];
+	unsigned int i;
+	int ret;
+
+	setting->offset = 0.0;
+	ret = sscanf(arg, "%15[a-z]:%u:%f:%f", name, &setting->frequency,
+			&setting->amplitude, &setting->offset);
+	if (ret < 3)
+		return -1;
+
+	for (i = 0; i < sizeof(wave_names) / sizeof(wave_names[0]); i++) {
+		if (strcmp(name, wave_names[i]) == 0) {
+			setting->wave = i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sim_setting setting;
+	const char *path = NULL;
+	double seconds = SIM_DEFAULT_SECONDS;
+	uint32_t rate = SIM_DEFAULT_RATE;
+	uint32_t step_limit = 0;
+	int failed = 0;
+	uint64_t samples = 0;
+	uint64_t end;
+	uint64_t t;
+	uint32_t code;
+	bool enabled;
+	bool csv = false;
+	FILE *f;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "t:r:s:co:")) != -1) {
+		switch (opt) {
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 's':
+			step_limit = atoi(optarg);
+			break;
+		case 'c':
+			csv = true;
+			break;
+		case 'o':
+			path = optarg;
+			break;
+		default:
+			path = NULL;
+			optind = argc;
+			break;
+		}
+	}
+
+	if (!path || (optind >= argc) || (seconds <= 0) || (rate == 0)) {
+		fprintf(stderr, "Usage: %s [-t seconds] [-r rate] [-s step] [-c] -o file "
+				"wave:freq:amp[:offset] ...\n", argv[0]);
+		return 1;
+	}
+
+	if (periph_init())
+		return 1;
+
+	f = fopen(path, csv ? "w" : "wb");
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+
+	if (csv)
+		fprintf(f, "time_s,code,volts\n");
+	else
+		write_wav_header(f, rate, 0);
+
+	systick_init();
+	periph_set_dac_hook(&record_conversion);
+
+	printf("setting                     min   max  step  freq Hz\n");
+
+	for (i = optind; i < argc; i++) {
+		if (parse_setting(argv[i], &setting)) {
+			fprintf(stderr, "Bad setting %s\n", argv[i]);
+			fclose(f);
+			return 1;
+		}
+
+		memset(&stats, 0, sizeof(stats));
+		stats.last_code = -1;
+
+		periph_sync();
+		generate_waveform(setting.wave, setting.frequency,
+				setting.amplitude, setting.offset);
+		while (continue_generate())
+			;
+
+		end = periph_now() + (uint64_t)(seconds * PERIPH_CLOCK_HZ);
+
+		while (1) {
+			t = (samples * PERIPH_CLOCK_HZ) / rate;
+			if (t >= end)
+				break;
+
+			periph_run_until(t);
+			code = periph_read_dac(&enabled);
+			if (!enabled)
+				code = 0;
+
+			if (csv)
+				fprintf(f, "%.7f,%u,%.4f\n", (double)t / PERIPH_CLOCK_HZ,
+						code, code * DAC_VREF / (DAC_RESOLUTION - 1));
+			else
+				write_le(f, (code << 4) - 0x8000, 2);
+
+			samples++;
+		}
+
+		periph_run_until(end);
+
+		printf("%-26s %5u %5u %5u  %.3f\n", argv[i], stats.min, stats.max,
+			stats.max_step, (stats.crossings > 1) ?
+				(double)(stats.crossings - 1) * PERIPH_CLOCK_HZ /
+					(stats.last_crossing - stats.first_crossing) : 0.0);
+
+		if (step_limit && (i > optind) && (stats.max_step > step_limit)) {
+			printf("step of %u codes at %s is over %u\n", stats.max_step,
+					argv[i], step_limit);
+			failed = 1;
+		}
+	}
+
+	if (!csv) {
+		fseek(f, 0, SEEK_SET);
+		write_wav_header(f, rate, samples);
+	}
+
+	fclose(f);
+	return failed;
+}
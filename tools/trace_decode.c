@@ -0,0 +1,200 @@
+
+/** @file trace_decode.c
+ *  @brief Host decoder for the event trace dump
+ *
+ *	Reads a serial capture containing a trace dump from the Trace > Dump menu
+ *	and prints the records as a timeline. The capture may contain any other
+ *	terminal output, the dump is found by its magic.
+ *
+ *	Build and run on the host:
+ *		gcc -Wall -O2 -o trace_decode tools/trace_decode.c
+ *		./trace_decode capture.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../trace.h"
+
+/** Names of the waveforms in enum waveform order */
+static const char *wave_names[] = {
+	"SINE", "SAWTOOTH", "TRIANGLE", "SQUARE", "HARMONIC", "PULSE"
+};
+
+/** @brief Reads a little endian 32 bit value.
+ *	@param p Bytes to read.
+ *	@returns The value.
+ */
+static uint32_t read_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/** @brief Reads a little endian 16 bit value.
+ *	@param p Bytes to read.
+ *	@returns The value.
+ */
+static uint16_t read_u16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/** @brief Prints the description of a record.
+ *	@param id Record identifier.
+ *	@param arg Record argument.
+ */
+static void print_record(uint32_t id, uint32_t arg)
+{
+	uint32_t wave;
+
+	switch (id) {
+	case TRACE_DAC_CONFIG:
+		printf("configure_dac      %u samples%s\n", arg & 0x3FFFFF,
+			(arg & (1ul << 23)) ? ", full init" :
+			(arg & (1ul << 22)) ? ", timer only" : "");
+		break;
+	case TRACE_GENERATE:
+		wave = arg >> 20;
+		printf("generate_waveform  %s %u Hz\n",
+			(wave < sizeof(wave_names) / sizeof(wave_names[0])) ?
+				wave_names[wave] : "?", arg & 0xFFFFF);
+		break;
+	case TRACE_GENERATE_DONE:
+		printf("generate done      %s, build %u us\n",
+			(arg & (1ul << 23)) ? "ok" : "FAILED", arg & 0x7FFFFF);
+		break;
+	case TRACE_USART2_IRQ:
+		if (arg >> 16)
+			printf("USART2 tx burst    %u%s bytes\n", arg >> 16,
+				((arg >> 16) == 0xFF) ? " or more" : "");
+		else
+			printf("USART2 IRQ         ISR 0x%04x%s%s%s%s\n", arg & 0xFFFF,
+				(arg & (1ul << 5)) ? " RXNE" : "",
+				(arg & (1ul << 3)) ? " ORE" : "",
+				(arg & (1ul << 2)) ? " NE" : "",
+				(arg & (1ul << 1)) ? " FE" : "");
+		break;
+	case TRACE_TIMER_IRQ:
+		printf("TIM%u IRQ\n", arg);
+		break;
+	case TRACE_DAC_UNDERRUN:
+		printf("DAC DMA underrun   #%u, restarted\n", arg);
+		break;
+	case TRACE_SETTINGS:
+		printf("settings posted    #%u\n", arg);
+		break;
+	case TRACE_PRESET:
+		printf("preset             %u %s\n", arg & 0x7FFFFF,
+			(arg & (1ul << 23)) ? "saved" : "loaded");
+		break;
+	default:
+		printf("unknown id %u arg 0x%06x\n", id, arg);
+		break;
+	}
+}
+
+/** @brief Decodes the dump found in a buffer.
+ *	@param buf Captured bytes.
+ *	@param len Number of bytes.
+ *	@returns 0 if a dump was decoded and -1 if otherwise.
+ */
+static int decode(const unsigned char *buf, size_t len)
+{
+	const unsigned char *p;
+	const unsigned char *end;
+	uint32_t written;
+	uint32_t count;
+	uint32_t cycles_per_us;
+	uint32_t first;
+	uint32_t prev;
+	uint32_t cycles;
+	uint32_t info;
+	uint32_t i;
+
+	end = buf + len;
+	for (p = buf; p + 4 <= end; p++) {
+		if (memcmp(p, TRACE_DUMP_MAGIC, 4) == 0)
+			break;
+	}
+
+	if (p + 4 + sizeof(struct trace_dump_header) > end) {
+		fprintf(stderr, "No trace dump found\n");
+		return -1;
+	}
+
+	p += 4;
+	written = read_u32(p);
+	count = read_u16(p + 4);
+	cycles_per_us = read_u16(p + 6);
+	p += sizeof(struct trace_dump_header);
+
+	if ((cycles_per_us == 0) ||
+		(p + count * sizeof(struct trace_record) > end)) {
+		fprintf(stderr, "Trace dump is truncated or corrupt\n");
+		return -1;
+	}
+
+	printf("%u records, %u lost, %u cycles per us\n\n", count,
+		written - count, cycles_per_us);
+	printf("     #      time us     delta us  event\n");
+
+	first = read_u32(p);
+	prev = first;
+
+	for (i = 0; i < count; i++, p += sizeof(struct trace_record)) {
+		cycles = read_u32(p);
+		info = read_u32(p + 4);
+
+		/* Cycle counter differences are correct across its wrap */
+		printf("%6u %12.1f %12.1f  ", written - count + i,
+			(double)(uint32_t)(cycles - first) / cycles_per_us,
+			(double)(uint32_t)(cycles - prev) / cycles_per_us);
+		print_record(info >> TRACE_ID_SHIFT, info & TRACE_ARG_MASK);
+
+		prev = cycles;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char *buf;
+	size_t len;
+	size_t size;
+	FILE *f;
+	int ret;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s capture\n", argv[0]);
+		return 1;
+	}
+
+	f = fopen(argv[1], "rb");
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	len = 0;
+	size = 4096;
+	buf = malloc(size);
+	while (buf && (ret = fread(buf + len, 1, size - len, f)) > 0) {
+		len += ret;
+		if (len == size) {
+			size *= 2;
+			buf = realloc(buf, size);
+		}
+	}
+	fclose(f);
+
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	ret = decode(buf, len);
+	free(buf);
+
+	return ret ? 1 : 0;
+}
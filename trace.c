@@ -0,0 +1,99 @@
+
+/** @file trace.c
+ *  @brief Event trace
+ *
+ *	Interrupt handlers and the main loop write timestamped 8 byte records into
+ *	a ring buffer which always holds the latest TRACE_SIZE records. Writing a
+ *	record takes no lock, only a few instructions with interrupts masked, so
+ *	it can be used from any interrupt without changing its timing much.
+ *
+ *	The buffer is dumped in binary over the serial port and decoded on the
+ *	host with tools/trace_decode.c.
+ */
+
+#include <stdbool.h>
+#include "stm32f0xx.h"
+#include "trace.h"
+#include "systick.h"
+#include "serial.h"
+
+static void trace_send(const void *data, uint32_t len);
+
+/** Ring buffer of records */
+static struct trace_record trace_buf[TRACE_SIZE];
+
+/** Number of records written, the next record goes to its low bits */
+static volatile uint32_t trace_written;
+
+/** Records are dropped while the buffer is being dumped */
+static volatile bool trace_paused;
+
+/** @brief Writes a record.
+ *	@param id Record identifier.
+ *	@param arg 24 bit argument, higher bits are dropped.
+ *
+ *	This is safe to call from interrupt handlers.
+ */
+void trace_event(enum trace_id id, uint32_t arg)
+{
+	struct trace_record *rec;
+	uint32_t primask;
+
+	if (trace_paused)
+		return;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	rec = &trace_buf[trace_written & (TRACE_SIZE - 1)];
+	trace_written++;
+	rec->cycles = systick_get_cycles();
+	rec->info = ((uint32_t)id << TRACE_ID_SHIFT) | (arg & TRACE_ARG_MASK);
+
+	__set_PRIMASK(primask);
+}
+
+/** @brief Removes all records.
+ */
+void trace_clear(void)
+{
+	trace_written = 0;
+}
+
+/** @brief Sends bytes on the serial port.
+ *	@param data Bytes to send.
+ *	@param len Number of bytes.
+ */
+static void trace_send(const void *data, uint32_t len)
+{
+	serial_write_blocking(data, len);
+}
+
+/** @brief Dumps the buffer in binary on the serial port.
+ *
+ *	TRACE_DUMP_MAGIC is followed by struct trace_dump_header and the records,
+ *	oldest first. Tracing is paused during the dump so the interrupts of the
+ *	dump itself are not recorded.
+ */
+void trace_dump(void)
+{
+	struct trace_dump_header header;
+	uint32_t first;
+	uint32_t i;
+
+	trace_paused = true;
+
+	header.written = trace_written;
+	header.count = (trace_written < TRACE_SIZE) ? trace_written : TRACE_SIZE;
+	header.cycles_per_us = systick_cycles_per_us();
+	first = trace_written - header.count;
+
+	trace_send(TRACE_DUMP_MAGIC, 4);
+	trace_send(&header, sizeof(header));
+
+	for (i = 0; i < header.count; i++)
+		trace_send(&trace_buf[(first + i) & (TRACE_SIZE - 1)],
+			sizeof(struct trace_record));
+
+	trace_paused = false;
+}
@@ -0,0 +1,53 @@
+
+/** @file trace.h
+ *  @brief Event trace include file
+ *
+ *	Shared with the host decoder in tools/trace_decode.c, so this only
+ *	depends on the standard headers.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/** Number of records kept, must be a power of two */
+#define TRACE_SIZE				128
+
+/** Start of a dump, followed by the dump header and the records */
+#define TRACE_DUMP_MAGIC		"TRC1"
+
+/** Bits of the record info word */
+#define TRACE_ID_SHIFT			24
+#define TRACE_ARG_MASK			0x00FFFFFFul
+
+/** Trace record identifiers */
+enum trace_id {
+	TRACE_DAC_CONFIG	= 1,	/** configure_dac(), arg bit 23 full init, bit 22 timer only, bits 0-21 sample count */
+	TRACE_GENERATE		= 2,	/** generate_waveform() entry, arg bits 20-23 waveform, bits 0-19 frequency */
+	TRACE_GENERATE_DONE	= 3,	/** generate_waveform() exit, arg bit 23 success, bits 0-22 build time in us */
+	TRACE_USART2_IRQ	= 4,	/** USART2 rx or error interrupt, or end of a tx burst, arg bits 16-23 bytes of the burst (255 at most), bits 0-15 USART2 ISR */
+	TRACE_TIMER_IRQ		= 5,	/** Timer interrupt, arg timer number */
+	TRACE_SETTINGS		= 6,	/** settings_post(), arg snapshot sequence number */
+	TRACE_DAC_UNDERRUN	= 7,	/** DAC DMA underrun recovered, arg underrun count */
+	TRACE_PRESET		= 8		/** Preset saved or loaded, arg bit 23 saved, bits 0-22 preset number */
+};
+
+/** One trace record, 8 bytes little endian */
+struct trace_record {
+	uint32_t cycles;		/** Core clock cycle counter when written */
+	uint32_t info;			/** Identifier in bits 24-31, argument in bits 0-23 */
+};
+
+/** Header sent after TRACE_DUMP_MAGIC, 8 bytes little endian */
+struct trace_dump_header {
+	uint32_t written;		/** Records written since start, older ones are lost */
+	uint16_t count;			/** Number of records following, oldest first */
+	uint16_t cycles_per_us;	/** Core clocks per microsecond */
+};
+
+void trace_event(enum trace_id id, uint32_t arg);
+void trace_clear(void);
+void trace_dump(void);
+
+#endif	/* TRACE_H */
@@ -9,228 +9,1596 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include "wave_gen.h"
+#include "systick.h"
+#include "trace.h"
+#include "freqmeter.h"
 
-/*data structure to store waveform sampling data*/
-uint32_t DMAData[MAX_MEMORY_ALLOWED];
+/*slot played by generate_waveform, its table is allocated from the arena*/
+static struct waveform_slot output_slot = {-1};
 
-/** @brief Process Waveform parameter and calculate the timing and number of sample
+/*slot of the table being built by continue_generate(), output_slot once played*/
+static struct waveform_slot build_slot = {-1};
+
+/*set if the table of output_slot or build_slot is at the top of the arena*/
+static uint8_t output_top = 0;
+static uint8_t build_top = 0;
+
+/*sample table being built and its data path*/
+static uint32_t* table_data = 0;
+static enum dma_data_size table_size = DMA_DATA_12BIT;
+
+/*DC offset added to every sample in DAC resolution*/
+static uint32_t offset_in_resolution = 0;
+
+/*number of sample clipped at the top of the DAC range in the current table*/
+static uint32_t clipped_samples = 0;
+
+/*copy of the slot currently played with its table resolved, noofsample is 0 if output is stopped*/
+static struct waveform_slot playing_slot = {-1};
+
+/*set while the timer is stopped by capture_phase() for a table rebuild*/
+static uint8_t output_halted = 0;
+
+/*DAC DMA underruns recovered since reset and the time of the last one*/
+static volatile uint32_t underrun_count = 0;
+static volatile uint32_t underrun_last_ms = 0;
+
+/*phase captured at the last waveform change in 1/65536 of a cycle*/
+static uint32_t captured_phase = 0;
+
+/*harmonic content used by the HARMONIC waveform, fundamental only by default*/
+static struct harmonic harmonic_list[MAX_HARMONICS] = {{1, 100, 0}};
+static uint32_t harmonic_count = 1;
+
+/*state of the HARMONIC table being generated, kept between ranges of steps*/
+static uint32_t harmonic_phase[MAX_HARMONICS];
+static uint32_t harmonic_step[MAX_HARMONICS];
+static int32_t harmonic_min;
+static int32_t harmonic_max;
+static uint32_t harmonic_shift;
+static uint32_t harmonic_scale;
+
+/*duty cycle of the PULSE waveform in percent*/
+static uint32_t pulse_duty = DEFAULT_PULSE_DUTY;
+
+/*set while the PULSE waveform is being output*/
+static uint8_t pulse_running = 0;
+
+/*time taken to build the last sample table*/
+static uint32_t table_build_time_us = 0;
+
+/*core clocks taken by the register writes of the last configure_dac()*/
+static uint32_t dac_config_cycles = 0;
+
+/*tells if the table being built is no longer wanted, 0 if none*/
+static uint8_t (*generate_abort)(void) = 0;
+
+/*number of tables of generate_waveform() dropped before they were played*/
+static uint32_t cancelled_builds = 0;
+
+/*parameters the table of generate_waveform() was built with, valid while
+  the harmonic content stays the same*/
+static uint8_t built_valid = 0;
+static enum waveform built_waveform;
+static uint32_t built_amplitude;
+static uint32_t built_offset;
+
+/*set while the table of generate_waveform() is built by continue_generate(),
+  build_slot and the built_ parameters describe it*/
+static uint8_t build_active = 0;
+static uint32_t build_next = 0;		/*next step to do*/
+static uint32_t build_steps = 0;	/*steps of the whole table*/
+static uint32_t build_phase = 0;	/*phase to start the table at if the output is held*/
+static uint32_t build_cycles = 0;	/*core clocks spent building so far*/
+
+/*number of frequency changes done by retiming the table being played*/
+static uint32_t retimed_changes = 0;
+
+/*table generate_waveform() builds for the default output at DEFAULT_TABLE_CLOCK,
+  one cycle of 400 samples played every 120 core clocks*/
+#define DEFAULT_TABLE_SAMPLES		400
+#define DEFAULT_TABLE_COUNT			119
+static const uint32_t default_table[DEFAULT_TABLE_SAMPLES] = {
+	2047, 2079, 2111, 2143, 2176, 2208, 2240, 2272, 2304, 2335,
+	2367, 2399, 2431, 2462, 2494, 2525, 2556, 2587, 2618, 2649,
+	2680, 2710, 2741, 2771, 2801, 2831, 2860, 2890, 2919, 2948,
+	2977, 3005, 3033, 3061, 3089, 3117, 3144, 3171, 3198, 3224,
+	3250, 3276, 3302, 3327, 3352, 3377, 3401, 3425, 3449, 3472,
+	3495, 3517, 3540, 3561, 3583, 3604, 3625, 3645, 3665, 3684,
+	3703, 3722, 3740, 3758, 3776, 3793, 3809, 3826, 3841, 3857,
+	3871, 3886, 3900, 3913, 3926, 3939, 3951, 3962, 3973, 3984,
+	3994, 4004, 4013, 4022, 4030, 4038, 4045, 4052, 4058, 4064,
+	4069, 4074, 4078, 4082, 4085, 4088, 4090, 4092, 4093, 4094,
+	4094, 4094, 4093, 4092, 4090, 4088, 4085, 4082, 4078, 4074,
+	4069, 4064, 4058, 4052, 4045, 4038, 4030, 4022, 4013, 4004,
+	3994, 3984, 3973, 3962, 3951, 3939, 3926, 3913, 3900, 3886,
+	3871, 3857, 3841, 3826, 3809, 3793, 3776, 3758, 3740, 3722,
+	3703, 3684, 3665, 3645, 3625, 3604, 3583, 3561, 3540, 3517,
+	3495, 3472, 3449, 3425, 3401, 3377, 3352, 3327, 3302, 3276,
+	3250, 3224, 3198, 3171, 3144, 3117, 3089, 3061, 3033, 3005,
+	2977, 2948, 2919, 2890, 2860, 2831, 2801, 2771, 2741, 2710,
+	2680, 2649, 2618, 2587, 2556, 2525, 2494, 2462, 2431, 2399,
+	2367, 2336, 2304, 2272, 2240, 2208, 2176, 2143, 2111, 2079,
+	2047, 2015, 1983, 1951, 1918, 1886, 1854, 1822, 1790, 1759,
+	1727, 1695, 1663, 1632, 1600, 1569, 1538, 1507, 1476, 1445,
+	1414, 1384, 1353, 1323, 1293, 1263, 1234, 1204, 1175, 1146,
+	1117, 1089, 1061, 1033, 1005,  977,  950,  923,  896,  870,
+	 844,  818,  792,  767,  742,  717,  693,  669,  645,  622,
+	 599,  577,  554,  533,  511,  490,  469,  449,  429,  410,
+	 391,  372,  354,  336,  318,  301,  285,  268,  253,  237,
+	 223,  208,  194,  181,  168,  155,  143,  132,  121,  110,
+	 100,   90,   81,   72,   64,   56,   49,   42,   36,   30,
+	  25,   20,   16,   12,    9,    6,    4,    2,    1,    0,
+	   0,    0,    1,    2,    4,    6,    9,   12,   16,   20,
+	  25,   30,   36,   42,   49,   56,   64,   72,   81,   90,
+	 100,  110,  121,  132,  143,  155,  168,  181,  194,  208,
+	 223,  237,  253,  268,  285,  301,  318,  336,  354,  372,
+	 391,  410,  429,  449,  469,  490,  511,  533,  554,  577,
+	 599,  622,  645,  669,  693,  717,  742,  767,  792,  818,
+	 844,  870,  896,  923,  950,  977, 1005, 1033, 1061, 1089,
+	1117, 1146, 1175, 1204, 1234, 1263, 1293, 1323, 1353, 1384,
+	1414, 1445, 1476, 1507, 1538, 1569, 1600, 1632, 1663, 1695,
+	1727, 1758, 1790, 1822, 1854, 1886, 1918, 1951, 1983, 2015
+};
+
+/*first quarter of a sine cycle in Q15, 256 steps plus the end point*/
+static const int16_t quarter_sine[257] = {
+	    0,   201,   402,   603,   804,  1005,  1206,  1407,
+	 1608,  1809,  2009,  2210,  2410,  2611,  2811,  3012,
+	 3212,  3412,  3612,  3811,  4011,  4210,  4410,  4609,
+	 4808,  5007,  5205,  5404,  5602,  5800,  5998,  6195,
+	 6393,  6590,  6786,  6983,  7179,  7375,  7571,  7767,
+	 7962,  8157,  8351,  8545,  8739,  8933,  9126,  9319,
+	 9512,  9704,  9896, 10087, 10278, 10469, 10659, 10849,
+	11039, 11228, 11417, 11605, 11793, 11980, 12167, 12353,
+	12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828,
+	14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269,
+	15446, 15623, 15800, 15976, 16151, 16325, 16499, 16673,
+	16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+	18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357,
+	19519, 19680, 19841, 20000, 20159, 20317, 20475, 20631,
+	20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+	22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027,
+	23170, 23311, 23452, 23592, 23731, 23870, 24007, 24143,
+	24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+	25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198,
+	26319, 26438, 26556, 26674, 26790, 26905, 27019, 27133,
+	27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001,
+	28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803,
+	28898, 28992, 29085, 29177, 29268, 29358, 29447, 29534,
+	29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+	30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783,
+	30852, 30919, 30985, 31050, 31113, 31176, 31237, 31297,
+	31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736,
+	31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098,
+	32137, 32176, 32213, 32250, 32285, 32318, 32351, 32382,
+	32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+	32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717,
+	32728, 32737, 32745, 32752, 32757, 32761, 32765, 32766,
+	32767
+};
+
+/** @brief Split a timer period into timer count and prescalar
+ *	@param clocks is the timer period in core clock
+ *	pCount is pointer to store output timer count, ticks per update
+ *	pPrescalar is pointer to store output timer prescalar register value
+ *	@returns the timer period in core clock that the timer actually produces.
+ *
+ *	Periods that do not fit the 16 bit counter search a few prescalars for one
+ *	that divides the period exactly, or else lands closest.
+ */
+static uint32_t split_timer(uint32_t clocks, uint32_t* pCount, uint32_t* pPrescalar)
+{
+	uint32_t div;
+	uint32_t last;
+	uint32_t count;
+	uint32_t err;
+	uint32_t best_err;
+	
+	div=(clocks-1)/65536+1;
+	if(div==1)
+	{
+		*pCount=clocks;
+		*pPrescalar=0;
+		return clocks;
+	}
+	
+	best_err=0xFFFFFFFF;
+	for(last=div+PLAN_SEARCH_WINDOW;div<last&&div<=65536;div++)
+	{
+		count=(clocks+div/2)/div;
+		if(count>65536)
+			continue;
+		
+		err=(count*div>clocks)?count*div-clocks:clocks-count*div;
+		if(err<best_err)
+		{
+			best_err=err;
+			*pCount=count;
+			*pPrescalar=div-1;
+			if(err==0)
+				break;
+		}
+	}
+	
+	return *pCount*(*pPrescalar+1);
+}
+
+/** @brief Convert a voltage to DAC resolution
+ *	@param volt is the floating point value in v
+ *	@returns the value in DAC resolution, rounded
+ */
+static uint32_t to_resolution(float volt)
+{
+	return volt*(DAC_RESOLUTION-1)/DAC_VREF+0.5;
+}
+
+/** @brief Find the longest sample period the planner may use for a waveform
+ *	@param waveform is the waveform types
+ *	@returns the sample period in core clock
+ *
+ *	Square waves have two samples per cycle so long periods are left to the
+ *	prescalar, other waveforms would drag visibly between samples.
+ */
+static uint32_t max_sample_clocks(enum waveform waveform)
+{
+	if(waveform==SQUARE)
+		return 0xFFFFFFFF;
+	return ((uint64_t)SystemCoreClock*DAC_SAMPLE_MAX_DRAG_TIME_NS)/1000000000;
+}
+
+/** @brief Find the shortest sample period the planner may use
+ *	@returns the sample period in core clock
+ *
+ *	The DAC limits how fast samples can follow each other and every sample
+ *	costs the bus one DMA transfer, which may take up to DMA_MAX_LOAD_PERCENT
+ *	of the bus. Whichever is slower sets the fastest sample rate.
+ */
+static uint32_t min_sample_clocks(void)
+{
+	uint32_t dac_clocks;
+	uint32_t dma_clocks;
+	
+	dac_clocks=((uint64_t)SystemCoreClock*DAC_SAMPLE_MIN_TIME_NS+999999999)/1000000000;
+	dma_clocks=(DMA_TRANSFER_CLOCKS*100+DMA_MAX_LOAD_PERCENT-1)/DMA_MAX_LOAD_PERCENT;
+	
+	return (dac_clocks>dma_clocks)?dac_clocks:dma_clocks;
+}
+
+/** @brief Plan the table size, cycles packed and timer values for a frequency
+ *	@param frequency is the waveform frequency in Hz
+ *	min_spc and max_spc are the limits of sample per cycle
+ *	max_clocks is the longest sample period allowed in core clock
+ *	max_sample is the number of sample that fits in the table
+ *	slot is pointer to store the planned table size and timer values
+ *	@returns 1 if the frequency can be planned and 0 if otherwise.
+ *
+ *	k cycles of N samples of T core clocks play at k*clock/(N*T) Hz. A single
+ *	cycle often cannot hit the frequency with integer N and T, so every k up
+ *	to MAX_TABLE_CYCLES is tried with the largest N allowed by the table size
+ *	and the shortest sample period, and a few below it. N and T are chosen
+ *	together, so the most samples per cycle that hit the frequency win.
+ *	Packing more cycles costs sample per cycle once the table size limits N,
+ *	so a larger k has to land PLAN_PACK_GAIN times closer to be taken and
+ *	must keep PLAN_PACK_KEEP_PERCENT of the sample per cycle a single cycle
+ *	fits. Where the sample rate limits N, packing costs nothing.
+ *	The search stops at the first match within PLAN_TOLERANCE_PPM.
+ *
+ *	@note MAX_TABLE_CYCLES*SystemCoreClock must fit in 32 bits.
+ */
+static uint8_t plan_table(uint32_t frequency, uint32_t min_spc, uint32_t max_spc, uint32_t max_clocks, uint32_t max_sample, struct waveform_slot* slot)
+{
+	uint32_t min_clocks;
+	uint32_t tolerance;
+	uint32_t k;
+	uint32_t n;
+	uint32_t n_lo;
+	uint32_t n_hi;
+	uint32_t total;
+	uint32_t clocks;
+	uint32_t actual;
+	uint32_t count;
+	uint32_t prescalar;
+	uint32_t err;
+	uint32_t best_err;
+	uint32_t best_k;
+	uint32_t min_pack_spc;
+	
+	min_clocks=min_sample_clocks();
+	tolerance=SystemCoreClock/1000000*PLAN_TOLERANCE_PPM;
+	best_err=0xFFFFFFFF;
+	best_k=0;
+	
+	for(k=1;k<=MAX_TABLE_CYCLES&&best_err>tolerance*best_k;k++)
+	{
+		/*core clocks in k cycles times frequency*/
+		total=k*SystemCoreClock;
+		
+		n_hi=total/frequency/min_clocks;
+		if(n_hi>max_sample)
+			n_hi=max_sample;
+		if(n_hi>k*max_spc)
+			n_hi=k*max_spc;
+		
+		n_lo=k*min_spc;
+		if(n_lo<total/frequency/max_clocks+1)
+			n_lo=total/frequency/max_clocks+1;
+		if(n_hi>PLAN_SEARCH_WINDOW&&n_lo<n_hi-PLAN_SEARCH_WINDOW)
+			n_lo=n_hi-PLAN_SEARCH_WINDOW;
+		
+		/*packed cycles must keep most of the sample per cycle of a single one*/
+		if(k==1)
+			min_pack_spc=n_hi*PLAN_PACK_KEEP_PERCENT/100;
+		else if(n_lo<k*min_pack_spc)
+			n_lo=k*min_pack_spc;
+		
+		for(n=n_hi;n>=n_lo&&n>0;n--)
+		{
+			clocks=(total+frequency*n/2)/(frequency*n);
+			actual=split_timer(clocks,&count,&prescalar)*n*frequency;
+			err=(actual>total)?actual-total:total-actual;
+			
+			/*compare err/k against best_err/best_k*/
+			if(best_k==0||(k==best_k&&err<best_err)
+				||(k>best_k&&err*best_k*PLAN_PACK_GAIN<best_err*k))
+			{
+				best_err=err;
+				best_k=k;
+				slot->noofsample=n;
+				slot->cycles=k;
+				/*timer counts ARR+1 ticks per update*/
+				slot->timer_count=count-1;
+				slot->timer_prescalar=prescalar;
+				slot->error_ppb=(((int64_t)total-actual)*1000000000)/actual;
+				if(err<=tolerance*k)
+					break;
+			}
+		}
+	}
+	
+	return best_k!=0;
+}
+
+/** @brief Process Waveform parameter and plan the sample table
  *	@param waveform is the waveform types
  *	frequency is the waveform frequency in Hz
  *	amplitude is the floating point value of waveform amplitude in v 
- *	pTiming_ns is pointer to store output sampling timing in ns
- *	pNoofSample is pointer to store output sample number 
+ *	max_words is the size of the table in 32 bit words
+ *	slot is pointer to store the planned table size, data path and timing
  *	@returns 1 if parameter acceptable and 0 if otherwise.
+ *
+ *	The 8-bit data path fits four times the samples of the 12-bit one but has
+ *	16 times fewer amplitude levels. It is chosen only when the 12-bit table
+ *	misses PLAN_TOLERANCE_PPM and the 8-bit one lands PLAN_PACK_GAIN times
+ *	closer to the requested frequency.
  */
-static uint8_t process_waveform_param(enum waveform waveform, uint32_t frequency, float amplitude, uint32_t* pTiming_ns, uint32_t* pNoofSample)
+static uint8_t process_waveform_param(enum waveform waveform, uint32_t frequency, float amplitude, uint32_t max_words, struct waveform_slot* slot)
 {
-	uint32_t period_in_ns;
-
-	period_in_ns=1000000000/frequency;
+	struct waveform_slot slot_8bit;
+	uint32_t max_clocks;
 	
 	if(amplitude>MAX_AMPLITUDE_FLOAT||amplitude<MIN_AMPLITUDE_FLOAT)
 	{
 		return 0;
 	}
 	
+	if(frequency<MIN_FREQUENCY)
+	{
+		return 0;
+	}
+	
+	slot->size = DMA_DATA_12BIT;
+	max_clocks=max_sample_clocks(waveform);
+	
 	switch(waveform)
 	{
 		case SINE:
 		case SAWTOOTH :
 		case TRIANGLE:
-			*pNoofSample = period_in_ns/DAC_SAMPLE_WAIT_TIME_NS;
-		
-			if(*pNoofSample<MIN_SAMPLE_PER_CYCLE)
+		case HARMONIC:
+			if(!plan_table(frequency, MIN_SAMPLE_PER_CYCLE, 0xFFFF, max_clocks, max_words, slot))
 				return 0;
-				
-			if(*pNoofSample>MAX_MEMORY_ALLOWED)
+			
+			if(plan_table(frequency, MIN_SAMPLE_PER_CYCLE, 0xFFFF, max_clocks, max_words*4, &slot_8bit)
+				&& slot_8bit.noofsample!=slot->noofsample
+				&& (uint32_t)abs(slot->error_ppb) > PLAN_TOLERANCE_PPM*1000
+				&& (uint32_t)abs(slot_8bit.error_ppb)*PLAN_PACK_GAIN < (uint32_t)abs(slot->error_ppb))
 			{
-				*pNoofSample=period_in_ns/DAC_SAMPLE_MAX_DRAG_TIME_NS;
-				if(*pNoofSample>MAX_MEMORY_ALLOWED)
-				{
-					return 0;
-				}
-				else
-				{
-					*pTiming_ns=period_in_ns/MAX_MEMORY_ALLOWED;
-					*pNoofSample=MAX_MEMORY_ALLOWED;
-				}
-			}
-			else
-			{
-				//timing = DAC_SAMPLE_WAIT_TIME_MS;
-				*pTiming_ns =  period_in_ns/(*pNoofSample);
+				slot->noofsample = slot_8bit.noofsample;
+				slot->cycles = slot_8bit.cycles;
+				slot->timer_count = slot_8bit.timer_count;
+				slot->timer_prescalar = slot_8bit.timer_prescalar;
+				slot->error_ppb = slot_8bit.error_ppb;
+				slot->size = DMA_DATA_8BIT;
 			}
 		break;
 		case SQUARE:
-			*pNoofSample=2;
-			*pTiming_ns =  period_in_ns/(*pNoofSample);
+			/*two samples per cycle, long periods go to the prescalar*/
+			if(!plan_table(frequency, 2, 2, max_clocks, max_words, slot))
+				return 0;
 		break;
 		default:
 			return 0;
 	}
 	
+	slot->frequency = frequency;
+	slot->rotation = 0;
 	return 1;
 }
 
+/** @brief Store a sample into the table being built using its data path
+ *	@param index is the position of the sample in the table
+ *	value is the sample in DAC resolution
+ *
+ *	The DC offset is added here with saturation at the top of the DAC range,
+ *	so it costs no extra pass over the table. Saturated samples are counted.
+ */
+static void store_sample(uint32_t index, uint32_t value)
+{
+	value+=offset_in_resolution;
+	if(value>DAC_RESOLUTION-1)
+	{
+		value=DAC_RESOLUTION-1;
+		clipped_samples++;
+	}
+	
+	if(table_size==DMA_DATA_8BIT)
+		((uint8_t*)table_data)[index]=value>>4;
+	else
+		table_data[index]=value;
+}
+
+/** @brief Swap two samples in the table being built using its data path
+ *	@param a and b are the positions of the samples to swap
+ */
+static void swap_samples(uint32_t a, uint32_t b)
+{
+	uint8_t byte;
+	uint32_t word;
+	
+	if(table_size==DMA_DATA_8BIT)
+	{
+		byte=((uint8_t*)table_data)[a];
+		((uint8_t*)table_data)[a]=((uint8_t*)table_data)[b];
+		((uint8_t*)table_data)[b]=byte;
+	}
+	else
+	{
+		word=table_data[a];
+		table_data[a]=table_data[b];
+		table_data[b]=word;
+	}
+}
+
+/** @brief Reverse the order of a range of samples in the table being built
+ *	@param first is the position of the first sample of the range
+ *	end is the position after the last sample of the range
+ */
+static void reverse_table(uint32_t first, uint32_t end)
+{
+	while(first+1<end)
+	{
+		end--;
+		swap_samples(first,end);
+		first++;
+	}
+}
+
+/** @brief Rotate the sample table so that it starts at a given phase
+ *	@param NoOfSample is the number of sample for this waveform
+ *	Cycles is the number of waveform cycle in the table
+ *	phase is the phase the table should start at in 1/65536 of a cycle
+ *
+ *	@returns the number of samples the table is rotated by
+ *
+ *	The table is rotated in place with three reversals so that no second
+ *	buffer is needed. The start is picked within the first cycle.
+ */
+static uint32_t rotate_table(uint32_t NoOfSample, uint32_t Cycles, uint32_t phase)
+{
+	uint32_t offset;
+	
+	offset=((phase*NoOfSample)/Cycles+0x8000)>>16;
+	offset%=NoOfSample;
+	if(offset==0)
+		return 0;
+	
+	reverse_table(0,offset);
+	reverse_table(offset,NoOfSample);
+	reverse_table(0,NoOfSample);
+	return offset;
+}
+
+/** @brief Stop the output and capture the phase of the next sample to play
+ *	@returns the phase in 1/65536 of a cycle, 0 if the output is stopped
+ *
+ *	Stopping the timer freezes the DMA so CNDTR tells exactly how far into
+ *	the table the output is. The rotation of the table is added back, so the
+ *	phase is that of the waveform and not of the table position. The DAC
+ *	keeps holding its last sample.
+ */
+static uint32_t capture_phase(void)
+{
+	uint32_t remaining;
+	uint32_t position;
+	
+	if(playing_slot.noofsample==0)
+		return 0;
+	
+	timer_disable_fixed(TIMER_IDX);
+	output_halted = 1;
+	remaining=dma_read_count_fixed(DMA_CHN);
+	
+	position=(playing_slot.noofsample-remaining+playing_slot.rotation)%playing_slot.noofsample;
+	position=(position*playing_slot.cycles)%playing_slot.noofsample;
+	return (position<<16)/playing_slot.noofsample;
+}
+
 /** @brief Generate SawTooth WaveForm Sampling Data
  *	@param NoOfSample is the number of sample for this waveform
+ *	Cycles is the number of waveform cycle in the table
  *	amplitude_in_resolution is amplitude of waveform in DAC resolution
+ *	first is the position of the first sample to generate
+ *	end is the position after the last sample to generate
+ *
+ *	Sample i is amplitude*position/NoOfSample. The quotient and remainder of
+ *	amplitude*position are kept and stepped by those of amplitude*Cycles, so
+ *	the loop has no divide and gives the same values as the division. They
+ *	are found with one divide at the first sample of the range.
  */
-static void generate_sawtooth_table(uint32_t NoOfSample, uint32_t amplitude_in_resolution)
+static void generate_sawtooth_table(uint32_t NoOfSample, uint32_t Cycles, uint32_t amplitude_in_resolution, uint32_t first, uint32_t end)
 {
 	uint32_t i;
-	for(i=0;i<NoOfSample;i++)
+	uint32_t position;
+	uint32_t value;
+	uint32_t remainder;
+	uint32_t step;
+	uint32_t step_remainder;
+	
+	step=amplitude_in_resolution*Cycles/NoOfSample;
+	step_remainder=amplitude_in_resolution*Cycles%NoOfSample;
+	
+	/*position within the cycle in 1/NoOfSample of a cycle*/
+	position=(first*Cycles)%NoOfSample;
+	value=amplitude_in_resolution*position/NoOfSample;
+	remainder=amplitude_in_resolution*position%NoOfSample;
+	for(i=first;i<end;i++)
 	{
-		DMAData[i]=(amplitude_in_resolution*i/NoOfSample);
+		store_sample(i,value);
+		
+		value+=step;
+		remainder+=step_remainder;
+		if(remainder>=NoOfSample)
+		{
+			remainder-=NoOfSample;
+			value++;
+		}
+		
+		position+=Cycles;
+		if(position>=NoOfSample)
+		{
+			position-=NoOfSample;
+			value-=amplitude_in_resolution;
+		}
 	}
 }
 
 /** @brief Generate Triangular WaveForm Sampling Data
  *	@param NoOfSample is the number of sample for this waveform
+ *	Cycles is the number of waveform cycle in the table
  *	amplitude_in_resolution is amplitude of waveform in DAC resolution
+ *
+ *	first is the position of the first sample to generate
+ *	end is the position after the last sample to generate
+ *
+ *	Uses the divide free ramp of generate_sawtooth_table(). The falling half
+ *	is taken from the same ramp less amplitude*(NoOfSample/2), whose quotient
+ *	and remainder are found once before the loop.
  */
-static void generate_triangular_table(uint32_t NoOfSample, uint32_t amplitude_in_resolution)
+static void generate_triangular_table(uint32_t NoOfSample, uint32_t Cycles, uint32_t amplitude_in_resolution, uint32_t first, uint32_t end)
 {
 	uint32_t i;
+	uint32_t position;
+	uint32_t value;
+	uint32_t remainder;
+	uint32_t step;
+	uint32_t step_remainder;
+	uint32_t half;
+	uint32_t half_remainder;
 
-	for(i=0;i<NoOfSample/2;i++)
+	step=amplitude_in_resolution*Cycles/NoOfSample;
+	step_remainder=amplitude_in_resolution*Cycles%NoOfSample;
+	half=amplitude_in_resolution*(NoOfSample/2)/NoOfSample;
+	half_remainder=amplitude_in_resolution*(NoOfSample/2)%NoOfSample;
+
+	position=(first*Cycles)%NoOfSample;
+	value=amplitude_in_resolution*position/NoOfSample;
+	remainder=amplitude_in_resolution*position%NoOfSample;
+	for(i=first;i<end;i++)
 	{
-		DMAData[i]=2*(amplitude_in_resolution*i/NoOfSample);
+		if(position<NoOfSample/2)
+			store_sample(i,2*value);
+		else if(remainder<half_remainder)
+			store_sample(i,amplitude_in_resolution-2*(value-half-1));
+		else
+			store_sample(i,amplitude_in_resolution-2*(value-half));
+		
+		value+=step;
+		remainder+=step_remainder;
+		if(remainder>=NoOfSample)
+		{
+			remainder-=NoOfSample;
+			value++;
+		}
+		
+		position+=Cycles;
+		if(position>=NoOfSample)
+		{
+			position-=NoOfSample;
+			value-=amplitude_in_resolution;
+		}
 	}
+}
 
-	for(i=0;i<NoOfSample/2;i++)
+/** @brief Generate Sine WaveForm Sampling Data
+ *	@param NoOfSample is the number of sample for this waveform
+ *	Cycles is the number of waveform cycle in the table
+ *	amplitude_in_resolution is amplitude of waveform in DAC resolution
+ *	first is the position of the first sample to generate
+ *	end is the position after the last sample to generate
+ */
+static void generate_sine_table(uint32_t NoOfSample, uint32_t Cycles, uint32_t amplitude_in_resolution, uint32_t first, uint32_t end)
+{
+	uint32_t i;
+	
+	for(i=first;i<end;i++)
 	{
-		DMAData[i+NoOfSample/2]=amplitude_in_resolution-(2*(amplitude_in_resolution*i/NoOfSample));
+		store_sample(i,(sin(((i*Cycles)%NoOfSample)*2*PI_VALUE/NoOfSample)+1)*amplitude_in_resolution/2);
 	}
 }
 
-/** @brief Generate Sine WaveForm Sampling Data
+/** @brief Look up a sine value from the quarter wave table
+ *	@param phase is the phase in 1/2^32 of a cycle
+ *	@returns sine of phase in Q15, linearly interpolated between table steps
+ */
+static int32_t lookup_sine(uint32_t phase)
+{
+	uint32_t position;
+	uint32_t index;
+	int32_t value;
+	
+	/*8 bit table index and 8 bit fraction within the quadrant*/
+	position=(phase>>14)&0xFFFF;
+	if(phase&0x40000000)
+		position=0x10000-position;
+	
+	index=position>>8;
+	value=quarter_sine[index];
+	if(index<256)
+		value+=((quarter_sine[index+1]-value)*(int32_t)(position&0xFF))>>8;
+	
+	if(phase&0x80000000)
+		return -value;
+	else
+		return value;
+}
+
+/** @brief Sum the harmonics for one sample of a Harmonic WaveForm
+ *	@param phase is the array of phase accumulators, one per harmonic
+ *	step is the array of phase step per sample, one per harmonic
+ *	@returns the sum of the harmonics, accumulators are advanced a sample
+ */
+static int32_t sum_harmonics(uint32_t* phase, const uint32_t* step)
+{
+	uint32_t h;
+	int32_t sum;
+	
+	sum=0;
+	for(h=0;h<harmonic_count;h++)
+	{
+		sum+=harmonic_list[h].amplitude*lookup_sine(phase[h]);
+		phase[h]+=step[h];
+	}
+	
+	return sum;
+}
+
+/** @brief Generate Harmonic WaveForm Sampling Data
  *	@param NoOfSample is the number of sample for this waveform
+ *	Cycles is the number of waveform cycle in the table
  *	amplitude_in_resolution is amplitude of waveform in DAC resolution
+ *	first is the first step to do
+ *	end is the step after the last step to do
+ *
+ *	Each harmonic is stepped through the quarter wave table with an integer
+ *	phase accumulator. The table takes 2*NoOfSample steps: the first pass
+ *	finds the peaks of the sum and the second pass stores the sum scaled to
+ *	fit between 0 and amplitude_in_resolution. The accumulators and peaks
+ *	are kept between calls, so the steps must be done in order.
  */
-static void generate_sine_table(uint32_t NoOfSample, uint32_t amplitude_in_resolution)
+static void generate_harmonic_table(uint32_t NoOfSample, uint32_t Cycles, uint32_t amplitude_in_resolution, uint32_t first, uint32_t end)
 {
 	uint32_t i;
+	uint32_t h;
+	int32_t sum;
 	
-	for(i=0;i<NoOfSample;i++)
+	if(first==0)
 	{
-		DMAData[i]=(sin(i*2*PI_VALUE/NoOfSample)+1)*(amplitude_in_resolution+1)/2;
+		for(h=0;h<harmonic_count;h++)
+		{
+			harmonic_step[h]=(0xFFFFFFFF/NoOfSample+1)*harmonic_list[h].order*Cycles;
+			harmonic_phase[h]=harmonic_list[h].phase*11930465;	/*2^32/360*/
+		}
+		harmonic_min=0;
+		harmonic_max=0;
+	}
+	
+	for(i=first;i<end;i++)
+	{
+		if(i==NoOfSample)
+		{
+			/*16.16 fixed point scale from the peak to peak range to the amplitude,
+			  the range is shifted down to 16 bit to keep the scale precise*/
+			harmonic_shift=0;
+			while(((uint32_t)(harmonic_max-harmonic_min)>>harmonic_shift)>0xFFFF)
+				harmonic_shift++;
+			
+			if(harmonic_max>harmonic_min)
+				harmonic_scale=(amplitude_in_resolution<<16)/((uint32_t)(harmonic_max-harmonic_min)>>harmonic_shift);
+			else
+				harmonic_scale=0;
+			
+			/*accumulators are back at the start after the whole table*/
+			for(h=0;h<harmonic_count;h++)
+				harmonic_phase[h]=harmonic_list[h].phase*11930465;
+		}
+		
+		sum=sum_harmonics(harmonic_phase,harmonic_step);
+		if(i<NoOfSample)
+		{
+			/*find the peaks*/
+			if(i==0||sum<harmonic_min)
+				harmonic_min=sum;
+			if(i==0||sum>harmonic_max)
+				harmonic_max=sum;
+		}
+		else
+		{
+			store_sample(i-NoOfSample,(((uint32_t)(sum-harmonic_min)>>harmonic_shift)*harmonic_scale)>>16);
+		}
 	}
 }
 
 /** @brief Generate Square WaveForm Sampling Data
  *	@param NoOfSample is the number of sample for this waveform
+ *	Cycles is the number of waveform cycle in the table
  *	amplitude_in_resolution is amplitude of waveform in DAC resolution
+ *	first is the position of the first sample to generate
+ *	end is the position after the last sample to generate
  */
-static void generate_square_table(uint32_t amplitude_in_resolution)
+static void generate_square_table(uint32_t NoOfSample, uint32_t Cycles, uint32_t amplitude_in_resolution, uint32_t first, uint32_t end)
 {
-	DMAData[0]=0;
-	DMAData[1]=amplitude_in_resolution;
+	uint32_t i;
+	
+	for(i=first;i<end;i++)
+	{
+		if(((i*Cycles)%NoOfSample)<NoOfSample/2)
+			store_sample(i,0);
+		else
+			store_sample(i,amplitude_in_resolution);
+	}
+}
+
+/** @brief Give the number of steps taken to generate a table
+ *	@param  waveform indicates the types of waveform
+ *	NoOfSample is the number of sample for this waveform
+ *	@returns the number of steps, one per sample or two for HARMONIC
+ */
+static uint32_t table_steps(enum waveform waveform, uint32_t NoOfSample)
+{
+	if(waveform==HARMONIC)
+		return 2*NoOfSample;
+	else
+		return NoOfSample;
+}
+
+/** @brief Give the arena space taken by the table of a slot
+ *	@param  slot is the planned slot
+ *	@returns the size of the table in 32 bit words
+ */
+static uint32_t table_words(const struct waveform_slot* slot)
+{
+	if(slot->size==DMA_DATA_8BIT)
+		return (slot->noofsample+3)/4;
+	else
+		return slot->noofsample;
 }
 
 /** @brief Generate WaveForm Sampling Data according to types
  *	@param  waveform indicates the types of waveform
  *	NoOfSample is the number of sample for this waveform
+ *	Cycles is the number of waveform cycle packed in the table
  *	amplitude_in_resolution is amplitude of waveform in DAC resolution
+ *	first is the first step to do
+ *	end is the step after the last step to do, up to table_steps()
+ *
+ *	A table may be generated in several calls over consecutive ranges of
+ *	steps, as long as no other table is generated in between.
  */
-static void generate_waveform_table(enum waveform waveform, uint32_t NoOfSample, uint32_t amplitude_in_resolution)
+static void generate_waveform_table(enum waveform waveform, uint32_t NoOfSample, uint32_t Cycles, uint32_t amplitude_in_resolution, uint32_t first, uint32_t end)
 {
 	switch (waveform)
 	{
 		case SINE:
-			generate_sine_table(NoOfSample,amplitude_in_resolution);
+			generate_sine_table(NoOfSample,Cycles,amplitude_in_resolution,first,end);
 		break;
 		case SAWTOOTH:
-			generate_sawtooth_table(NoOfSample,amplitude_in_resolution);
+			generate_sawtooth_table(NoOfSample,Cycles,amplitude_in_resolution,first,end);
 		break;
 		case TRIANGLE:
-			generate_triangular_table(NoOfSample,amplitude_in_resolution);
+			generate_triangular_table(NoOfSample,Cycles,amplitude_in_resolution,first,end);
 		break;
 		case SQUARE:
-			generate_square_table(amplitude_in_resolution);
+			generate_square_table(NoOfSample,Cycles,amplitude_in_resolution,first,end);
+		break;
+		case HARMONIC:
+			generate_harmonic_table(NoOfSample,Cycles,amplitude_in_resolution,first,end);
+		break;
+		default:
 		break;
 	}
 }
 
+/** @brief Restart the DMA of the DAC after an underrun
+ *	@note called from the DAC underrun interrupt with DAC DMA disabled
+ *
+ *	The DMA channel is set up again on the table being played. Circular mode
+ *	cannot resume from the middle of the table, so the output restarts at the
+ *	first sample.
+ */
+static void recover_underrun(void)
+{
+	underrun_count++;
+	underrun_last_ms = systick_get_ms();
+	trace_event(TRACE_DAC_UNDERRUN,underrun_count&TRACE_ARG_MASK);
+	
+	if(playing_slot.noofsample==0)
+		return;
+	
+	dma_disable_fixed(DMA_CHN);
+	dma_load_fixed(DMA_CHN,playing_slot.table,playing_slot.noofsample,playing_slot.size);
+	dma_enable_fixed(DMA_CHN);
+	freqmeter_start(playing_slot.noofsample,playing_slot.cycles);
+}
+
 /** @brief configure the DAC, DMA and timer to trigger waveform generation
- *	@param  noofsample is the number of sample for this waveform
- *	period_in_ns is timing in to grab a sample to output in DAC in nano seconds
+ *	@param  slot is the prepared sample table and its timing
+ *
+ *	A stopped output is fully initialized. A running output is compared with
+ *	the slot and only what differs is written, the DAC is left on to hold its
+ *	output:
+ *	- another table, or one rewritten while the output was halted, restarts
+ *	  the DMA at its first sample, the data path only if it changed
+ *	- timer values go to the preload registers only if they changed and take
+ *	  effect together at the next update
+ *	A new period on the same table therefore leaves the DMA running and the
+ *	output changes frequency at a sample boundary without a phase jump.
+ *	The table is read from the arena unless the slot points to one elsewhere.
+ *
+ *	The channels are fixed at compile time, so the fixed driver variants
+ *	compile to the register writes alone.
  */
-static void configure_dac(uint32_t noofsample, uint32_t period_in_ns)
+static void configure_dac(const struct waveform_slot* slot)
 {
-	uint32_t timer_count;
-	uint32_t timer_prescalar;
+	const uint32_t* table;
+	uint32_t start;
+	uint8_t full;
+	uint8_t reload;
+	
+	table = slot->table ? slot->table : arena_ptr(slot->handle);
+	full = (playing_slot.noofsample==0);
+	reload = full||output_halted||table!=playing_slot.table
+		||slot->noofsample!=playing_slot.noofsample||slot->size!=playing_slot.size;
+	
+	trace_event(TRACE_DAC_CONFIG,(full<<23)|((!reload)<<22)|(slot->noofsample&0x3FFFFF));
 	
-	//disable all peripheral to make changes
-	timer_disable(TIMER_IDX);
-	dma_disable(DMA_CHN);
-	dac_disable(DAC_CHN);
+	start = systick_get_cycles();
 	
+	if(full)
+	{
+		//disable peripheral to make changes
+		dma_disable_fixed(DMA_CHN);
+		timer_disable_fixed(TIMER_IDX);
+		
+		/* Initialize DAC */
+		dac_disable_fixed(DAC_CHN);
+		dac_init(DAC_CHN);
+		dac_enable_fixed(DAC_CHN);
+		dac_enable_underrun_interrupt(DAC_CHN,&recover_underrun);
+		
+		timer_init(TIMER_IDX, 0, 0);
+		dma_init(DMA_CHN,table,slot->noofsample,slot->size);
+		dma_enable_fixed(DMA_CHN);
+	}
+	else if(reload)
+	{
+		dma_disable_fixed(DMA_CHN);
+		if(slot->size==playing_slot.size)
+			dma_reload_fixed(DMA_CHN,table,slot->noofsample);
+		else
+			dma_load_fixed(DMA_CHN,table,slot->noofsample,slot->size);
+		dma_enable_fixed(DMA_CHN);
+	}
 
-	/* Initialize DAC */
-	dac_init(DAC_CHN);
-	dac_enable(DAC_CHN);
+	/* Timer values through the preload */
+	if(full||slot->timer_count!=playing_slot.timer_count)
+		timer_write_counter_fixed(TIMER_IDX,slot->timer_count);
+	if(full||slot->timer_prescalar!=playing_slot.timer_prescalar)
+		timer_write_prescaler_fixed(TIMER_IDX,slot->timer_prescalar);
+	if(full||output_halted)
+		timer_enable_fixed(TIMER_IDX);
+	output_halted = 0;
 	
-	/* Initialize DMA */
-	dma_init(DMA_CHN,DMAData,noofsample);
-	dma_enable(DMA_CHN);
+	dac_config_cycles = systick_get_cycles() - start;
+	
+	playing_slot = *slot;
+	playing_slot.table = table;
+	freqmeter_start(slot->noofsample,slot->cycles);
+}
 
-	/* Initialize Timer */
+/** @brief Output a pulse train on the timer output according to waveform parameter
+ *	@param  frequency is the pulse frequency in Hz
+ *	@returns 1 if the pulse train is started and 0 if otherwise.
+ */
+static uint8_t draw_pulse(uint32_t frequency)
+{
+	if(frequency>MAX_PULSE_FREQUENCY||frequency<MIN_FREQUENCY)
+		return 0;
+	
+	if(!pulse_running)
+		pwm_init();
 	
-	timer_prescalar=1;
-	//prescalar and count calculation
-	while(1)
+	if(pwm_write_frequency(frequency,pulse_duty))
+		return 0;
+	
+	pwm_enable();
+	pulse_running = 1;
+	return 1;
+}
+
+/** @brief Stop the pulse train on the timer output
+ */
+static void stop_pulse(void)
+{
+	if(pulse_running)
 	{
-		timer_count=period_in_ns/(TIMER_TICK_NS*(timer_prescalar+1));
-		if(timer_count>65535)
-		{
-			timer_prescalar=timer_prescalar*2;
-		}
-		else
-		{
-			break;
-		}
+		pwm_disable();
+		pulse_running = 0;
 	}
+}
 
-	timer_init(TIMER_IDX, 0, 0);
-	timer_write_counter(TIMER_IDX, timer_count);
-	timer_write_prescaler(TIMER_IDX,timer_prescalar);
-	timer_enable(TIMER_IDX);
+/** @brief Allocate the table of a planned slot as the table being built
+ *	@param  offset is the floating point value of the DC offset in v
+ *	top places the table at the top of the arena instead of the bottom
+ *	slot is the planned slot, its table is allocated
+ *	@returns 1 if the table is allocated and 0 if otherwise.
+ */
+static uint8_t allocate_planned(float offset, uint8_t top, struct waveform_slot* slot)
+{
+	slot->handle = -1;
+	slot->table = 0;
+	
+	if(offset>MAX_OFFSET_FLOAT||offset<MIN_OFFSET_FLOAT)
+		return 0;
+	
+	if(top)
+		slot->handle = arena_alloc_top(table_words(slot)*4,4);
+	else
+		slot->handle = arena_alloc(table_words(slot)*4,4);
+	if(slot->handle<0)
+		return 0;
+	
+	offset_in_resolution = to_resolution(offset);
+	table_data = arena_ptr(slot->handle);
+	table_size = slot->size;
+	clipped_samples = 0;
+	return 1;
 }
 
-/** @brief Draw waveform in DAC output port according to processed information
+/** @brief Plan a sample table and allocate it as the table being built
  *	@param  waveform indicates the types of waveform
- *	amplitude_in_resolution is amplitude of waveform in DAC resolution
- *	timing_ns is timing in to grab a sample to output in DAC in nano seconds
- *	noOfSample is the number of sample for this waveform
+ *	frequency is the waveform frequency in Hz
+ *	amplitude is the floating point value of waveform amplitude in v 
+ *	offset is the floating point value of the DC offset in v
+ *	max_words is the largest table allowed in 32 bit words, it is further
+ *	limited to the free space of the arena
+ *	slot is pointer to store the planned table and timer values
+ *	@returns 1 if the table is allocated and 0 if otherwise.
  */
-static void draw_waveform(enum waveform waveform, uint32_t amplitude_in_resolution, uint32_t timing_ns,	uint32_t noOfSample)
+static uint8_t allocate_table(enum waveform waveform, uint32_t frequency, float amplitude, float offset, uint32_t max_words, struct waveform_slot* slot)
 {
-	generate_waveform_table(waveform,noOfSample,amplitude_in_resolution);
-	configure_dac(noOfSample, timing_ns);
+	struct arena_stats stats;
+	
+	slot->handle = -1;
+	slot->table = 0;
+	
+	/*compaction on allocation makes all free space usable*/
+	arena_read_stats(&stats);
+	if(max_words>(stats.size-stats.used)/4)
+		max_words=(stats.size-stats.used)/4;
+	
+	if(!process_waveform_param(waveform, frequency, amplitude, max_words, slot))
+		return 0;
+	
+	return allocate_planned(offset, 0, slot);
+}
+
+/** @brief Drop the table of generate_waveform() being built, if any
+ *	@note the table played is left as it is
+ */
+static void cancel_build(void)
+{
+	if(!build_active)
+		return;
+	
+	build_active = 0;
+	release_waveform(&build_slot);
+	cancelled_builds++;
+	trace_event(TRACE_GENERATE_DONE,(build_cycles/systick_cycles_per_us())&0x7FFFFF);
+}
+
+/** @brief Prepare a sample table and its timing for a waveform
+ *	@param  waveform indicates the types of waveform
+ *	frequency is the waveform frequency in Hz
+ *	amplitude is the floating point value of waveform amplitude in v 
+ *	offset is the floating point value of the DC offset in v
+ *	max_words is the largest table allowed in 32 bit words, it is further
+ *	limited to the free space of the arena
+ *	slot is pointer to store the prepared table and timer values
+ *	@returns 1 if the waveform is prepared and 0 if otherwise.
+ *
+ *	Only DAC waveforms can be prepared. The table is allocated from the arena
+ *	and is owned by the slot until release_waveform() is called. The slot can
+ *	be played later with play_waveform() without any further calculation, the
+ *	table must be pinned in the arena while it is played.
+ *
+ *	The table is built at once. A table of generate_waveform() still being
+ *	built is dropped and the output is stopped.
+ */
+uint8_t prepare_waveform(enum waveform waveform, uint32_t frequency, float amplitude, float offset, uint32_t max_words, struct waveform_slot* slot)
+{
+	uint32_t start;
+	
+	if(build_active)
+		stop_waveform();
+	
+	if(!allocate_table(waveform, frequency, amplitude, offset, max_words, slot))
+		return 0;
+	
+	start = systick_get_cycles();
+	generate_waveform_table(waveform,slot->noofsample,slot->cycles,to_resolution(amplitude),
+		0,table_steps(waveform,slot->noofsample));
+	table_build_time_us = (systick_get_cycles() - start)/systick_cycles_per_us();
+	
+	return 1;
+}
+
+/** @brief Release the sample table of a prepared slot back to the arena
+ *	@param  slot is the prepared slot, it must not be played any more
+ */
+void release_waveform(struct waveform_slot* slot)
+{
+	arena_free(slot->handle);
+	slot->handle = -1;
+}
+
+/** @brief Play a prepared sample table on the DAC output port
+ *	@param  slot is the prepared sample table and its timing
+ *
+ *	Switching between prepared slots is only a few register writes so this
+ *	may be called from an interrupt.
+ */
+void play_waveform(const struct waveform_slot* slot)
+{
+	configure_dac(slot);
+}
+
+/** @brief Play a sample table kept outside the arena in place of generate_waveform()
+ *	@param  slot is the table and its timing, its table must point to the
+ *	samples and stay valid while played
+ *	@returns 1 if the table is played and 0 if otherwise.
+ *
+ *	Used to play a table stored in flash without building it again. The
+ *	pulse output is stopped and the table of generate_waveform() is released
+ *	once the DMA reads the new table, or dropped if still being built. The
+ *	output starts at the first sample of the table, the phase is not
+ *	continued.
+ */
+uint8_t restore_waveform(const struct waveform_slot* slot)
+{
+	if(slot->table==0||slot->noofsample==0)
+		return 0;
+	
+	stop_pulse();
+	configure_dac(slot);
+	cancel_build();
+	release_waveform(&output_slot);
+	captured_phase = 0;
+	return 1;
+}
+
+/** @brief Play the default output from its table in flash
+ *	@returns 1 if the default output is played and 0 if the core clock is not
+ *	the one the table is timed for.
+ *
+ *	Gives the same output as generate_waveform() with the default settings
+ *	without building a table, so the output starts right after the clock is
+ *	set up at boot.
+ */
+uint8_t play_default_waveform(void)
+{
+	struct waveform_slot slot = {-1};
+	
+	if(SystemCoreClock!=DEFAULT_TABLE_CLOCK)
+		return 0;
+	
+	slot.noofsample = DEFAULT_TABLE_SAMPLES;
+	slot.cycles = 1;
+	slot.error_ppb = 0;
+	slot.frequency = DEFAULT_FREQUENCY;
+	slot.rotation = 0;
+	slot.size = DMA_DATA_12BIT;
+	slot.timer_count = DEFAULT_TABLE_COUNT;
+	slot.timer_prescalar = 0;
+	slot.table = default_table;
+	
+	return restore_waveform(&slot);
+}
+
+/** @brief Stop the waveform on the DAC output port
+ *
+ *	The DAC keeps holding its last sample. The table of generate_waveform()
+ *	is released, or dropped if still being built, tables of slots played
+ *	with play_waveform() are left to their owner.
+ */
+void stop_waveform(void)
+{
+	timer_disable_fixed(TIMER_IDX);
+	freqmeter_stop();
+	playing_slot.noofsample = 0;
+	output_halted = 0;
+	cancel_build();
+	release_waveform(&output_slot);
+}
+
+/** @brief Plan new timer values to play the table of generate_waveform() at another frequency
+ *	@param  waveform is the waveform types
+ *	frequency is the waveform frequency in Hz
+ *	amplitude is the floating point value of waveform amplitude in v
+ *	slot is the slot being played, its timer values and error are replaced
+ *	@returns 1 if the table can be kept and 0 if a new table is needed.
+ *
+ *	The table is kept when the planner would build one of the same layout,
+ *	or when the new sample period stays in range and lands at least as close
+ *	to the frequency as a new table would.
+ */
+static uint8_t retime_table(enum waveform waveform, uint32_t frequency, float amplitude, struct waveform_slot* slot)
+{
+	struct waveform_slot fresh;
+	struct arena_stats stats;
+	uint32_t max_words;
+	uint64_t total;
+	uint64_t actual;
+	uint32_t clocks;
+	uint32_t count;
+	uint32_t prescalar;
+	int32_t error_ppb;
+	
+	/*a new table could take the place of the one played*/
+	arena_read_stats(&stats);
+	max_words=(stats.size-stats.used)/4;
+	max_words+=table_words(slot);
+	if(max_words>MAX_MEMORY_ALLOWED)
+		max_words=MAX_MEMORY_ALLOWED;
+	
+	if(!process_waveform_param(waveform, frequency, amplitude, max_words, &fresh))
+		return 0;
+	
+	if(fresh.noofsample==slot->noofsample&&fresh.cycles==slot->cycles&&fresh.size==slot->size)
+	{
+		slot->timer_count=fresh.timer_count;
+		slot->timer_prescalar=fresh.timer_prescalar;
+		slot->error_ppb=fresh.error_ppb;
+		slot->frequency=frequency;
+		return 1;
+	}
+	
+	total=(uint64_t)slot->cycles*SystemCoreClock;
+	clocks=(total+(uint64_t)frequency*slot->noofsample/2)/((uint64_t)frequency*slot->noofsample);
+	if(clocks<min_sample_clocks()||clocks>max_sample_clocks(waveform))
+		return 0;
+	
+	actual=(uint64_t)split_timer(clocks,&count,&prescalar)*slot->noofsample*frequency;
+	error_ppb=(((int64_t)total-(int64_t)actual)*1000000000)/(int64_t)actual;
+	if((uint32_t)abs(error_ppb)>(uint32_t)abs(fresh.error_ppb)
+		&&(uint32_t)abs(error_ppb)>PLAN_TOLERANCE_PPM*1000)
+		return 0;
+	
+	slot->timer_count=count-1;
+	slot->timer_prescalar=prescalar;
+	slot->error_ppb=error_ppb;
+	slot->frequency=frequency;
+	return 1;
 }
 
 /** @brief Draw waveform in DAC output port according to waveform parameter
  *	@param  waveform indicates the types of waveform
  *	frequency is the waveform frequency in Hz
  *	amplitude is the floating point value of waveform amplitude in v 
+ *	offset is the floating point value of the DC offset in v
+ *
+ *	The PULSE waveform is output by a timer on its own pin and stops the DAC
+ *	output, all other waveforms stop the pulse output.
+ *
+ *	A new table is only planned and allocated here, continue_generate() then
+ *	builds it GENERATE_CHUNK_SAMPLES at a time and plays it once complete. A
+ *	table still being built from an earlier call is dropped.
+ *
+ *	A running output is continued from the same phase, so the waveform has no
+ *	phase jump across changes. The old table keeps playing while the new one
+ *	is built if the new one fits in the free arena next to it, as tables of
+ *	up to half the arena do when nothing else is allocated. It is built at
+ *	the other end of the arena from the old one. Otherwise the output holds
+ *	its last sample while the new table is built, so the old table can be
+ *	released first.
+ *
+ *	A change of frequency alone keeps the table played if retime_table()
+ *	allows it. Only the timer is written then, the output does not halt and
+ *	changes frequency at the next sample.
  */
-void generate_waveform(enum waveform waveform, uint32_t frequency, float amplitude)
+void generate_waveform(enum waveform waveform, uint32_t frequency, float amplitude, float offset)
 {
-	uint32_t timing_ns;
-	uint32_t noOfSample;
-	uint32_t amplitude_in_resolution;
+	struct waveform_slot slot;
+	struct arena_stats stats;
+	uint32_t free_words;
+	uint32_t max_words;
+	uint8_t ok;
+	
+	trace_event(TRACE_GENERATE,(waveform<<20)|(frequency&0xFFFFF));
 	
-	if(process_waveform_param(waveform, frequency, amplitude, &timing_ns, &noOfSample))
+	if(waveform==PULSE)
 	{
-		amplitude_in_resolution = amplitude*DAC_RESOLUTION/DAC_VREF;
-		draw_waveform(waveform,amplitude_in_resolution,timing_ns,noOfSample);
+		stop_waveform();
+		ok=draw_pulse(frequency);
+		if(!ok)
+			stop_pulse();
+		trace_event(TRACE_GENERATE_DONE,ok<<23);
+		return;
 	}
-	else
+	
+	stop_pulse();
+	
+	if(built_valid&&output_slot.handle>=0&&playing_slot.handle==output_slot.handle
+		&&playing_slot.noofsample!=0&&built_waveform==waveform
+		&&built_amplitude==to_resolution(amplitude)&&built_offset==to_resolution(offset))
+	{
+		slot=output_slot;
+		if(retime_table(waveform, frequency, amplitude, &slot))
+		{
+			output_slot=slot;
+			configure_dac(&output_slot);
+			retimed_changes++;
+			trace_event(TRACE_GENERATE_DONE,1ul<<23);
+			return;
+		}
+	}
+	
+	cancel_build();
+	
+	/*plan with the room the old table would leave, so the new table is the
+	  same whether or not it is built next to the old one*/
+	arena_read_stats(&stats);
+	free_words=(stats.size-stats.used)/4;
+	max_words=free_words;
+	if(output_slot.handle>=0)
+		max_words+=table_words(&output_slot);
+	if(max_words>MAX_MEMORY_ALLOWED)
+		max_words=MAX_MEMORY_ALLOWED;
+	
+	/*built at the other end of the arena from the old table, so the two
+	  leave the free space in one piece*/
+	build_top = (output_slot.handle>=0)?!output_top:0;
+	build_phase = 0;
+	if(!process_waveform_param(waveform, frequency, amplitude, max_words, &build_slot)
+		||table_words(&build_slot)>free_words
+		||!allocate_planned(offset, build_top, &build_slot))
 	{
-		timer_disable(TIMER_IDX);
+		/*no room next to the old table, the output is halted so the old
+		  table can go before the new one is built*/
+		build_phase = capture_phase();
+		freqmeter_stop();
+		release_waveform(&output_slot);
+		
+		build_top = 0;
+		if(!allocate_table(waveform, frequency, amplitude, offset, max_words, &build_slot))
+		{
+			stop_waveform();
+			trace_event(TRACE_GENERATE_DONE,0);
+			return;
+		}
 	}
+	
+	/*pinned so the table stays in place between chunks*/
+	arena_pin(build_slot.handle,true);
+	built_valid = 0;
+	built_waveform = waveform;
+	built_amplitude = to_resolution(amplitude);
+	built_offset = to_resolution(offset);
+	build_next = 0;
+	build_steps = table_steps(waveform,build_slot.noofsample);
+	build_cycles = 0;
+	build_active = 1;
+}
+
+/** @brief Build the next chunk of the table of generate_waveform()
+ *	@returns 1 while the table is still being built and 0 if otherwise.
+ *
+ *	Does up to GENERATE_CHUNK_SAMPLES steps of the table, so the caller can
+ *	serve its input between calls. The table is played once complete, from
+ *	the phase the old table is at then, and the old table is released. If the
+ *	check set with set_generate_abort() says the table is no longer wanted,
+ *	it is dropped and the old table keeps playing, or the output stays held.
+ */
+uint8_t continue_generate(void)
+{
+	uint32_t end;
+	uint32_t start;
+	
+	if(!build_active)
+		return 0;
+	
+	if(generate_abort && generate_abort())
+	{
+		/*superseded while building, the caller generates the newer setting next*/
+		if(output_halted)
+			stop_waveform();
+		else
+			cancel_build();
+		return 0;
+	}
+	
+	end = build_next+GENERATE_CHUNK_SAMPLES;
+	if(end>build_steps)
+		end = build_steps;
+	
+	start = systick_get_cycles();
+	table_data = arena_ptr(build_slot.handle);
+	table_size = build_slot.size;
+	offset_in_resolution = built_offset;
+	generate_waveform_table(built_waveform,build_slot.noofsample,build_slot.cycles,built_amplitude,build_next,end);
+	build_cycles += systick_get_cycles() - start;
+	build_next = end;
+	
+	if(build_next<build_steps)
+		return 1;
+	
+	build_active = 0;
+	built_valid = 1;
+	table_build_time_us = build_cycles/systick_cycles_per_us();
+	
+	/*the old table played until now, the output only holds while the new
+	  table is rotated to its phase*/
+	if(!output_halted)
+		build_phase = capture_phase();
+	captured_phase = build_phase;
+	build_slot.rotation = rotate_table(build_slot.noofsample,build_slot.cycles,build_phase);
+	configure_dac(&build_slot);
+	release_waveform(&output_slot);
+	output_slot = build_slot;
+	output_top = build_top;
+	build_slot.handle = -1;
+	
+	trace_event(TRACE_GENERATE_DONE,(1ul<<23)|(table_build_time_us&0x7FFFFF));
+	return 0;
+}
+
+/** @brief Set the check that cancels a table superseded while building
+ *	@param  abort returns non zero when the table being built is no longer
+ *	wanted, NULL to never cancel
+ */
+void set_generate_abort(uint8_t (*abort)(void))
+{
+	generate_abort=abort;
+}
+
+/** @brief Set the duty cycle of the PULSE waveform
+ *	@param  duty is the duty cycle in percent, limited to 100
+ */
+void set_pulse_duty(uint32_t duty)
+{
+	if(duty>100)
+		duty=100;
+	pulse_duty=duty;
+}
+
+/** @brief Set the harmonic content of the HARMONIC waveform
+ *	@param  harmonics is the array of harmonics to sum
+ *	count is the number of harmonics in the array
+ *
+ *	Harmonics with an order of 0 or above MAX_HARMONIC_ORDER are dropped.
+ *	A HARMONIC table being built with other harmonics is dropped and the
+ *	output is stopped.
+ */
+void set_harmonics(const struct harmonic *harmonics, uint32_t count)
+{
+	struct harmonic old_list[MAX_HARMONICS];
+	uint32_t old_count;
+	uint32_t i;
+	
+	memcpy(old_list,harmonic_list,sizeof(old_list));
+	old_count=harmonic_count;
+	
+	harmonic_count=0;
+	for(i=0;i<count&&i<MAX_HARMONICS;i++)
+	{
+		if(harmonics[i].order==0||harmonics[i].order>MAX_HARMONIC_ORDER)
+			continue;
+		
+		harmonic_list[harmonic_count]=harmonics[i];
+		harmonic_list[harmonic_count].phase%=360;
+		harmonic_count++;
+	}
+	
+	/*a table built with other harmonics cannot be retimed*/
+	if(harmonic_count!=old_count||memcmp(old_list,harmonic_list,harmonic_count*sizeof(struct harmonic)))
+	{
+		built_valid=0;
+		if(build_active&&built_waveform==HARMONIC)
+			stop_waveform();
+	}
+}
+
+/** @brief Retrieve the time taken to build the last sample table
+ *	@returns build time in us.
+*/
+uint32_t get_table_build_time_us(void)
+{
+		return table_build_time_us;
+}
+
+/** @brief Retrieve how far the table of generate_waveform() is built
+ *	@returns percent of the table built, 100 if no table is being built.
+*/
+uint32_t get_generate_progress(void)
+{
+		if(!build_active)
+			return 100;
+		return build_next*100/build_steps;
+}
+
+/** @brief Tell if the output is held while a table is built
+ *	@returns 1 if the old table did not fit next to the table being built and
+ *	the output holds its last sample, 0 if otherwise.
+*/
+uint8_t get_output_held(void)
+{
+		return (build_active&&output_halted)?1:0;
+}
+
+/** @brief Retrieve the number of frequency changes done without a new table
+ *	@returns number of changes that only rewrote the timer.
+*/
+uint32_t get_retimed_changes(void)
+{
+		return retimed_changes;
+}
+
+/** @brief Retrieve the number of sample clipped by the DC offset
+ *	@returns number of sample of the current table clipped at the top of the
+ *	DAC range.
+*/
+uint32_t get_clipped_samples(void)
+{
+		return clipped_samples;
+}
+
+/** @brief Retrieve the number of built table dropped by the abort check
+ *	@returns number of table cancelled since reset.
+*/
+uint32_t get_cancelled_builds(void)
+{
+		return cancelled_builds;
+}
+
+/** @brief Retrieve the number of DAC DMA underrun recovered
+ *	@returns number of underrun since reset.
+*/
+uint32_t get_underrun_count(void)
+{
+		return underrun_count;
+}
+
+/** @brief Retrieve the time of the last DAC DMA underrun
+ *	@returns systick time in ms of the last underrun, 0 if there was none.
+*/
+uint32_t get_last_underrun_ms(void)
+{
+		return underrun_last_ms;
+}
+
+/** @brief Retrieve the cost of the last output reconfiguration
+ *	@returns core clocks taken by the register writes of the last table swap
+ *	or start, including reading the cycle counter once.
+*/
+uint32_t get_dac_config_cycles(void)
+{
+		return dac_config_cycles;
+}
+
+/** @brief Retrieve the number of waveform cycle packed in the played table
+ *	@returns number of cycle, 0 if no table is played.
+*/
+uint32_t get_table_cycles(void)
+{
+		return (playing_slot.noofsample==0)?0:playing_slot.cycles;
+}
+
+/** @brief Retrieve the sample rate of the played table
+ *	@returns sample rate in Hz, 0 if no table is played.
+*/
+uint32_t get_sample_rate(void)
+{
+		if(playing_slot.noofsample==0)
+			return 0;
+		return SystemCoreClock/((playing_slot.timer_count+1)*(playing_slot.timer_prescalar+1));
+}
+
+/** @brief Retrieve the fastest sample rate the planner may use
+ *	@returns sample rate in Hz.
+*/
+uint32_t get_max_sample_rate(void)
+{
+		return SystemCoreClock/min_sample_clocks();
+}
+
+/** @brief Retrieve the share of the bus taken by the DMA of the played table
+ *	@returns bus load in 1/1000, 0 if no table is played.
+*/
+uint32_t get_dma_load_permille(void)
+{
+		return ((uint64_t)get_sample_rate()*DMA_TRANSFER_CLOCKS*1000)/SystemCoreClock;
+}
+
+/** @brief Retrieve the frequency error of the played table
+ *	@returns frequency error in parts per billion, positive if the output is
+ *	faster than requested.
+*/
+int32_t get_frequency_error_ppb(void)
+{
+		return (playing_slot.noofsample==0)?0:playing_slot.error_ppb;
+}
+
+/** @brief Retrieve the table being played and its timing
+ *	@param  slot is pointer to store a copy of the played slot, its table
+ *	points to the samples wherever they are
+ *	@returns 1 if a table is played and 0 if otherwise, such as while the
+ *	output is held for a new table.
+*/
+uint8_t get_playing_waveform(struct waveform_slot* slot)
+{
+		*slot = playing_slot;
+		return (playing_slot.noofsample==0||output_halted)?0:1;
+}
+
+/** @brief Retrieve the phase the output was continued from at the last change
+ *	@returns phase in 1/65536 of a cycle, 0 if the output was started afresh.
+*/
+uint32_t get_captured_phase(void)
+{
+		return captured_phase;
 }
 
 /** @brief Retrieve the maximum waveform frequncy that the system supports
@@ -249,6 +1617,14 @@ uint32_t get_min_freq(void)
 {
 		return MIN_FREQUENCY;
 }
+
+/** @brief Retrieve the maximum pulse frequncy that the system supports
+ *	@returns value for maximum pulse frequency in Hz that the system supports.
+*/
+uint32_t get_max_pulse_freq(void)
+{
+		return MAX_PULSE_FREQUENCY;
+}
 /** @brief Retrieve the maximum waveform amplitude that the system supports
  *	@returns value for maximum amplitude in V that the system supports.
 */
@@ -263,4 +1639,19 @@ float get_min_amplitude(void)
 {
 		return MIN_AMPLITUDE_FLOAT;
 }
+/** @brief Retrieve the maximum DC offset that the system supports
+ *	@returns value for maximum offset in V that the system supports.
+*/
+float get_max_offset(void)
+{
+		return MAX_OFFSET_FLOAT;
+}
+/** @brief Retrieve the minimum DC offset that the system supports
+ *	@returns value for minimum offset in V that the system supports.
+*/
+float get_min_offset(void)
+{
+		return MIN_OFFSET_FLOAT;
+}
+
 
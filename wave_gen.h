@@ -10,6 +10,8 @@
 #include "dac.h"
 #include "dma.h"
 #include "timer.h"
+#include "pwm.h"
+#include "arena.h"
 
 /*define DAC channel and DMA channel to use DAC and DMA driver*/
 #define DAC_CHN				DAC_CHN_1
@@ -17,7 +19,6 @@
 #define TIMER_IDX			TIMER_IDX_6
 
 /* DAC peripheral limitation defines*/ 
-#define TIMER_TICK_NS		21
 #define CLOCK_SPEED			42000000
 #define DAC_RESOLUTION 4096
 #define DAC_VREF				3.3
@@ -28,26 +29,104 @@ enum waveform {
 	SINE 	 = 0,
 	SAWTOOTH	 = 1,
 	TRIANGLE = 2,
-	SQUARE = 3
+	SQUARE = 3,
+	HARMONIC = 4,
+	PULSE = 5		/*timer output on PA6 instead of the DAC*/
+};
+
+/*harmonic content of the HARMONIC waveform*/
+#define MAX_HARMONICS				8
+#define MAX_HARMONIC_ORDER			(MIN_SAMPLE_PER_CYCLE/2)
+
+struct harmonic {
+	uint8_t order;		/*multiple of the fundamental frequency, 1 is the fundamental*/
+	uint8_t amplitude;	/*relative amplitude in percent*/
+	uint16_t phase;		/*phase in degree*/
 };
 
 /*define for waveform data calculations*/
 #define PI_VALUE 3.14159
 #define MIN_SAMPLE_PER_CYCLE		50
-#define DAC_SAMPLE_WAIT_TIME_NS		10000
+#define DAC_SAMPLE_WAIT_TIME_NS		10000	/*sample period the frequency range is rated at*/
+#define DAC_SAMPLE_MIN_TIME_NS		1000	/*shortest DAC update period for small steps*/
 #define DAC_SAMPLE_MAX_DRAG_TIME_NS	1000000
+#define DMA_TRANSFER_CLOCKS			6		/*bus clocks taken by one DMA transfer to the DAC*/
+#define DMA_MAX_LOAD_PERCENT		5		/*share of the bus the DAC DMA may take*/
 #define MAX_MEMORY_ALLOWED			2000
+#define MAX_MEMORY_ALLOWED_8BIT		(MAX_MEMORY_ALLOWED*4)	/*8-bit samples are packed 4 per word*/
+#define MAX_TABLE_CYCLES			16	/*most waveform cycles packed in one table*/
+#define PLAN_SEARCH_WINDOW			64	/*table sizes or prescalars tried per step*/
+#define PLAN_PACK_GAIN				4	/*times closer more cycles or the 8-bit path must land*/
+#define PLAN_PACK_KEEP_PERCENT		50	/*share of the sample per cycle of one cycle packed cycles keep*/
+#define PLAN_TOLERANCE_PPM			1	/*frequency error taken without searching further*/
+#define GENERATE_CHUNK_SAMPLES		32	/*table steps built per continue_generate() call*/
 
 /*waveform parameter limitation defines*/
 #define MAX_AMPLITUDE_FLOAT		3.3
 #define MIN_AMPLITUDE_FLOAT		1.0
+#define MAX_OFFSET_FLOAT		DAC_VREF
+#define MIN_OFFSET_FLOAT		0.0
 #define MAX_FREQUENCY (1000000000/(DAC_SAMPLE_WAIT_TIME_NS*MIN_SAMPLE_PER_CYCLE))
 #define MIN_FREQUENCY 1
 
-extern void generate_waveform(enum waveform waveform, uint32_t frequency, float amplitude);
+/*default output, played at boot from DEFAULT_TABLE without building it*/
+#define DEFAULT_WAVEFORM			SINE
+#define DEFAULT_FREQUENCY			1000
+#define DEFAULT_AMPLITUDE_FLOAT		3.3
+#define DEFAULT_OFFSET_FLOAT		0.0
+#define DEFAULT_TABLE_CLOCK			48000000	/*core clock the default table is timed for*/
+
+/*pulse output limitation defines*/
+#define MAX_PULSE_FREQUENCY		1000000
+#define DEFAULT_PULSE_DUTY		50
+
+/*prepared sample table with the timer values to play it*/
+struct waveform_slot {
+	int handle;					/*arena block of sample table, -1 if none*/
+	uint32_t noofsample;		/*number of sample in table*/
+	uint32_t cycles;			/*number of waveform cycle in table*/
+	int32_t error_ppb;			/*frequency error in parts per billion*/
+	uint32_t frequency;			/*requested waveform frequency in Hz*/
+	uint32_t rotation;			/*first sample of the unrotated table played*/
+	enum dma_data_size size;	/*DAC data path of table*/
+	uint32_t timer_count;		/*timer ARR value*/
+	uint32_t timer_prescalar;	/*timer PSC value*/
+	const uint32_t* table;		/*sample table outside the arena such as in flash, 0 if in the arena*/
+};
+
+extern void generate_waveform(enum waveform waveform, uint32_t frequency, float amplitude, float offset);
+extern uint8_t continue_generate(void);
+extern uint8_t prepare_waveform(enum waveform waveform, uint32_t frequency, float amplitude, float offset, uint32_t max_words, struct waveform_slot* slot);
+extern void release_waveform(struct waveform_slot* slot);
+extern void play_waveform(const struct waveform_slot* slot);
+extern uint8_t restore_waveform(const struct waveform_slot* slot);
+extern uint8_t play_default_waveform(void);
+extern void stop_waveform(void);
+extern void set_harmonics(const struct harmonic *harmonics, uint32_t count);
+extern void set_pulse_duty(uint32_t duty);
+extern void set_generate_abort(uint8_t (*abort)(void));
+extern uint32_t get_table_build_time_us(void);
+extern uint32_t get_generate_progress(void);
+extern uint8_t get_output_held(void);
+extern uint32_t get_dac_config_cycles(void);
+extern uint32_t get_retimed_changes(void);
+extern uint32_t get_clipped_samples(void);
+extern uint32_t get_cancelled_builds(void);
+extern uint32_t get_underrun_count(void);
+extern uint32_t get_last_underrun_ms(void);
+extern uint32_t get_captured_phase(void);
+extern uint32_t get_table_cycles(void);
+extern uint32_t get_sample_rate(void);
+extern uint32_t get_max_sample_rate(void);
+extern uint32_t get_dma_load_permille(void);
+extern int32_t get_frequency_error_ppb(void);
+extern uint8_t get_playing_waveform(struct waveform_slot* slot);
 extern uint32_t get_max_freq(void);
 extern uint32_t get_min_freq(void);
+extern uint32_t get_max_pulse_freq(void);
 extern float get_max_amplitude(void);
 extern float get_min_amplitude(void);
+extern float get_max_offset(void);
+extern float get_min_offset(void);
 
 #endif	/* WAVE_GEN_H */